@@ -5,10 +5,45 @@
 #include <cctype>
 #include <curl/curl.h>
 #include <sstream>
+#include <fstream>
 #include <iomanip>
 #include <ctime>
 #include <cmath>
+#include <cstdint>
+#include <climits>
+#include <string_view>
+#include <charconv>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <unordered_set>
+#include <chrono>
+#include <random>
+#include <unordered_map>
 #include <map>
+#include <memory>
+#include <array>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <csignal>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -17,12 +52,25 @@ using namespace std;
 //https://console.groq.com/keys
 const string GROQ_API_KEY = "ENTER_KEY_HERE";
 const string GROQ_API_URL = "https://api.groq.com/openai/v1/chat/completions";
+const string GROQ_MODEL = "llama-3.1-8b-instant";
 
 // Semantic Scholar API
 const string SEMANTIC_SCHOLAR_API_URL = "https://api.semanticscholar.org/graph/v1/paper/search";
 
+// OpenAlex API (no key needed)
+const string OPENALEX_API_URL = "https://api.openalex.org/works";
+
+// Endpoints actually called; --groq-url / --semantic-scholar-url / --openalex-url point them at a stand-in server
+string groqApiUrl = GROQ_API_URL;
+string semanticScholarApiUrl = SEMANTIC_SCHOLAR_API_URL;
+string openAlexApiUrl = OPENALEX_API_URL;
+
+// Cleared by --no-llm-stream: wait for whole Groq responses instead of streaming them
+bool groqStreaming = true;
+
 // Structure to hold article information
 struct Article {
+    string paperId;
     string title;
     int year;
     int citationCount;
@@ -31,684 +79,6939 @@ struct Article {
     double relevancyScore;
 };
 
-// Callback function for libcurl to capture response
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* userp) {
-    userp->append((char*)contents, size * nmemb);
-    return size * nmemb;
-}
+// Location of one text field inside an ArticleBatch arena
+struct TextSpan {
+    uint32_t offset;
+    uint32_t length;
+};
 
-// Function to escape JSON strings
-string escapeJson(const string& input) {
-    string output;
-    for (char c : input) {
-        switch (c) {
-            case '"': output += "\\\""; break;
-            case '\\': output += "\\\\"; break;
-            case '\b': output += "\\b"; break;
-            case '\f': output += "\\f"; break;
-            case '\n': output += "\\n"; break;
-            case '\r': output += "\\r"; break;
-            case '\t': output += "\\t"; break;
-            default: output += c; break;
-        }
+// Structure-of-arrays store for large candidate sets
+// Years, citation counts and scores sit in contiguous arrays, and all text lives in one arena referenced
+// by offset/length, so adding an article costs no allocation of its own once the batch has grown.
+// Rows are built field by field (beginRow, setText, commitRow) so a parser can write straight into it.
+class ArticleBatch {
+public:
+    enum TextField { PAPER_ID, TITLE, ABSTRACT, URL, TEXT_FIELD_COUNT };
+    
+    vector<int> years;
+    vector<int> citationCounts;
+    vector<double> scores;  // Relevancy scores, 0 until scored
+    
+    size_t size() const { return years.size(); }
+    bool empty() const { return years.empty(); }
+    size_t textBytes() const { return committedBytes; }
+    
+    void reserve(size_t rows, size_t textBytes) {
+        years.reserve(rows);
+        citationCounts.reserve(rows);
+        scores.reserve(rows);
+        spans.reserve(rows * TEXT_FIELD_COUNT);
+        arena.reserve(textBytes);
     }
-    return output;
-}
-
-// Function to URL encode a string
-string urlEncode(const string& str) {
-    ostringstream escaped;
-    escaped.fill('0');
-    escaped << hex;
-
-    for (char c : str) {
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            escaped << c;
-        } else if (c == ' ') {
-            escaped << '+';
-        } else {
-            escaped << '%' << setw(2) << int((unsigned char)c);
-        }
+    
+    string_view text(size_t row, TextField field) const {
+        const TextSpan& span = spans[row * TEXT_FIELD_COUNT + field];
+        return string_view(arena.data() + span.offset, span.length);
     }
-
-    return escaped.str();
-}
-
-// Function to convert string to lowercase
-string toLowercase(string str) {
-    transform(str.begin(), str.end(), str.begin(), ::tolower);
-    return str;
-}
-
-// Function to tokenize text into words
-vector<string> tokenize(const string& text) {
-    vector<string> tokens;
-    string word;
-    string lowerText = toLowercase(text);
+    string_view paperId(size_t row) const { return text(row, PAPER_ID); }
+    string_view title(size_t row) const { return text(row, TITLE); }
+    string_view abstract(size_t row) const { return text(row, ABSTRACT); }
+    string_view url(size_t row) const { return text(row, URL); }
     
-    for (char c : lowerText) {
-        if (isalnum(c)) {
-            word += c;
-        } else if (!word.empty()) {
-            tokens.push_back(word);
-            word.clear();
+    // Function to start a new row, dropping whatever an unfinished row had written
+    void beginRow() {
+        arena.resize(committedBytes);
+        for (TextSpan& span : pending) {
+            span = {(uint32_t)committedBytes, 0};
         }
     }
-    if (!word.empty()) {
-        tokens.push_back(word);
-    }
     
-    return tokens;
-}
-
-// Function to calculate term frequency
-map<string, double> calculateTF(const vector<string>& tokens) {
-    map<string, double> tf;
-    for (const string& token : tokens) {
-        tf[token]++;
+    // Function to set a text field of the row being built (a repeated field replaces the earlier value)
+    void setText(TextField field, string_view value) {
+        pending[field] = {(uint32_t)arena.size(), (uint32_t)value.size()};
+        arena.append(value);
     }
-    // Normalize by total number of tokens
-    for (auto& pair : tf) {
-        pair.second /= tokens.size();
+    
+    void commitRow(int year, int citationCount) {
+        years.push_back(year);
+        citationCounts.push_back(citationCount);
+        scores.push_back(0.0);
+        spans.insert(spans.end(), pending, pending + TEXT_FIELD_COUNT);
+        committedBytes = arena.size();
     }
-    return tf;
-}
-
-// Function to calculate cosine similarity between two texts
-double calculateCosineSimilarity(const string& text1, const string& text2) {
-    vector<string> tokens1 = tokenize(text1);
-    vector<string> tokens2 = tokenize(text2);
     
-    if (tokens1.empty() || tokens2.empty()) {
-        return 0.0;
+    void append(string_view paperId, string_view title, int year, int citationCount, string_view abstract, string_view url) {
+        beginRow();
+        setText(PAPER_ID, paperId);
+        setText(TITLE, title);
+        setText(ABSTRACT, abstract);
+        setText(URL, url);
+        commitRow(year, citationCount);
     }
     
-    map<string, double> tf1 = calculateTF(tokens1);
-    map<string, double> tf2 = calculateTF(tokens2);
+    void append(const Article& article) {
+        append(article.paperId, article.title, article.year, article.citationCount, article.abstract, article.url);
+        scores.back() = article.relevancyScore;
+    }
     
-    // Calculate dot product and magnitudes
-    double dotProduct = 0.0;
-    double magnitude1 = 0.0;
-    double magnitude2 = 0.0;
+    // Function to copy a row of another batch, score included
+    void append(const ArticleBatch& other, size_t row) {
+        append(other.paperId(row), other.title(row), other.years[row], other.citationCounts[row],
+               other.abstract(row), other.url(row));
+        scores.back() = other.scores[row];
+    }
     
-    // Get all unique terms
-    map<string, bool> allTerms;
-    for (const auto& pair : tf1) allTerms[pair.first] = true;
-    for (const auto& pair : tf2) allTerms[pair.first] = true;
+    Article toArticle(size_t row) const {
+        Article article;
+        article.paperId.assign(paperId(row));
+        article.title.assign(title(row));
+        article.year = years[row];
+        article.citationCount = citationCounts[row];
+        article.abstract.assign(abstract(row));
+        article.url.assign(url(row));
+        article.relevancyScore = scores[row];
+        return article;
+    }
     
-    for (const auto& term : allTerms) {
-        double val1 = tf1.count(term.first) ? tf1[term.first] : 0.0;
-        double val2 = tf2.count(term.first) ? tf2[term.first] : 0.0;
-        
-        dotProduct += val1 * val2;
-        magnitude1 += val1 * val1;
-        magnitude2 += val2 * val2;
+    // Function to drop every row from the given one on
+    void truncate(size_t rows) {
+        if (rows >= size()) {
+            arena.resize(committedBytes);
+            return;
+        }
+        // A row's fields are all written at or after its start, and unset ones point at the start itself
+        size_t rowStart = committedBytes;
+        for (size_t field = 0; field < TEXT_FIELD_COUNT; field++) {
+            rowStart = min(rowStart, (size_t)spans[rows * TEXT_FIELD_COUNT + field].offset);
+        }
+        years.resize(rows);
+        citationCounts.resize(rows);
+        scores.resize(rows);
+        spans.resize(rows * TEXT_FIELD_COUNT);
+        arena.resize(rowStart);
+        committedBytes = rowStart;
     }
     
-    magnitude1 = sqrt(magnitude1);
-    magnitude2 = sqrt(magnitude2);
+    void clear() {
+        truncate(0);
+    }
     
-    if (magnitude1 == 0.0 || magnitude2 == 0.0) {
-        return 0.0;
+private:
+    vector<TextSpan> spans;                // TEXT_FIELD_COUNT per row
+    string arena;                          // Text of every row back to back (offsets limit it to 4 GB)
+    size_t committedBytes = 0;             // End of the last committed row's text
+    TextSpan pending[TEXT_FIELD_COUNT] = {};
+};
+
+// Per-thread allocation counters, read around timed code by the benchmark and the query metrics
+// Counting replaces the global operator new, so it is only compiled in when built with -DCOUNT_ALLOCATIONS.
+// Otherwise the counters stay at zero and allocations are left out of the reports.
+#if defined(COUNT_ALLOCATIONS)
+constexpr bool ALLOCATIONS_COUNTED = true;
+#else
+constexpr bool ALLOCATIONS_COUNTED = false;
+#endif
+thread_local uint64_t threadAllocationCount = 0;
+thread_local uint64_t threadAllocatedBytes = 0;
+
+#if defined(COUNT_ALLOCATIONS)
+void* operator new(size_t size) {
+    threadAllocationCount++;
+    threadAllocatedBytes += size;
+    if (void* memory = malloc(size ? size : 1)) {
+        return memory;
     }
+    throw bad_alloc();
+}
+
+// Kept out of line: once inlined, GCC pairs the free() with its builtin new and warns about a mismatch
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+#endif
+
+// Callback function for libcurl to capture response
+size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* userp) {
+    userp->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+// Structure to hold the result of an HTTP request
+struct HttpResponse {
+    CURLcode curlCode = CURLE_OK;  // Transport-level result
+    long status = 0;               // HTTP status code (0 if no response was received)
+    string body;
+    string retryAfter;             // Value of the Retry-After header, if the server sent one
     
-    return dotProduct / (magnitude1 * magnitude2);
+    // Transfer phases from curl_easy_getinfo, in seconds (0 when a live connection was reused)
+    double dnsSeconds = 0.0;
+    double connectSeconds = 0.0;
+    double tlsSeconds = 0.0;
+    double firstByteSeconds = 0.0;  // From the start of the request until the first response byte
+    double totalSeconds = 0.0;
+    curl_off_t bytesReceived = 0;
+    curl_off_t bytesSent = 0;
+    bool stoppedEarly = false;      // The streaming consumer had what it needed and the rest was not read
+};
+
+// Callback function for libcurl to capture response headers we care about
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems, HttpResponse* response) {
+    size_t length = size * nitems;
+    string_view line(buffer, length);
+    const string_view name = "retry-after:";
+    if (line.size() > name.size() &&
+        equal(name.begin(), name.end(), line.begin(), [](char a, char b) { return a == tolower((unsigned char)b); })) {
+        string_view value = line.substr(name.size());
+        size_t first = value.find_first_not_of(" \t");
+        size_t last = value.find_last_not_of(" \t\r\n");
+        response->retryAfter = first == string_view::npos ? "" : string(value.substr(first, last - first + 1));
+    }
+    return length;
 }
 
-// Function to calculate keyword match score
-double calculateKeywordMatchScore(const Article& article, const string& originalKeywords, const string& expandedKeywords) {
-    // Convert abstract to lowercase for matching
-    string lowerAbstract = toLowercase(article.abstract);
+// Cancellation flag of the search the current thread works for (null = not cancellable)
+// A search abandoned at its deadline sets the flag; its requests then stop at the next progress callback
+// and are not retried.
+thread_local const atomic<bool>* activeCancellation = nullptr;
+
+// Function to tell if the current thread's search has been abandoned
+bool searchCancelled() {
+    return activeCancellation && activeCancellation->load();
+}
+
+// Makes the current thread's requests cancellable through a flag until the scope ends
+class CancellationScope {
+public:
+    explicit CancellationScope(const atomic<bool>* cancelled) : previous(activeCancellation) {
+        activeCancellation = cancelled;
+    }
     
-    if (lowerAbstract.empty()) {
-        return 0.0;
+    ~CancellationScope() {
+        activeCancellation = previous;
     }
     
-    // Split original keywords (these are the important ones)
-    vector<string> originalKeywordList;
-    istringstream ss1(originalKeywords);
-    string keyword;
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
     
-    while (getline(ss1, keyword, ',')) {
-        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
-        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
-        if (!keyword.empty()) {
-            originalKeywordList.push_back(toLowercase(keyword));
+private:
+    const atomic<bool>* previous;
+};
+
+// Reusable HTTP client shared by every API call
+// Easy handles are pooled so their connections stay alive between calls, and the DNS cache and
+// TLS sessions are shared between handles through a CURLSH object. (libcurl does not support
+// sharing the connection cache itself between concurrent threads, so each pooled handle keeps its own.)
+// HTTP/2 is negotiated where the server supports it.
+class HttpClient {
+public:
+    HttpClient() {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        share = curl_share_init();
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    
+    ~HttpClient() {
+        for (CURL* handle : idleHandles) {
+            curl_easy_cleanup(handle);
         }
+        curl_share_cleanup(share);
+        curl_global_cleanup();
     }
     
-    // Split expanded keywords (these are supplementary)
-    vector<string> expandedKeywordList;
-    istringstream ss2(expandedKeywords);
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
     
-    while (getline(ss2, keyword, ',')) {
-        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
-        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
-        if (!keyword.empty()) {
-            string lowerKw = toLowercase(keyword);
-            // Only add if it's NOT in the original list (these are the deconstructed words)
-            if (find(originalKeywordList.begin(), originalKeywordList.end(), lowerKw) == originalKeywordList.end()) {
-                expandedKeywordList.push_back(lowerKw);
-            }
-        }
+    HttpResponse get(const string& url, const vector<string>& headers = {}) {
+        return perform(url, nullptr, headers);
     }
     
-    if (originalKeywordList.empty()) {
-        return 0.0;
+    HttpResponse post(const string& url, const string& body, const vector<string>& headers = {}) {
+        return perform(url, &body, headers);
     }
     
-    // Count matches for original keywords (HIGH value)
-    int originalMatches = 0;
-    for (const string& kw : originalKeywordList) {
-        if (lowerAbstract.find(kw) != string::npos) {
-            originalMatches++;
-        }
+    // Function to GET a URL, handing each chunk of a 200 response body to onData as it arrives
+    // The body is only also kept in the response if keepBody is set (error bodies are always kept)
+    HttpResponse getStreaming(const string& url, const function<void(string_view)>& onData, bool keepBody,
+                              const vector<string>& headers = {}) {
+        function<bool(string_view)> forward = [&onData](string_view chunk) {
+            onData(chunk);
+            return true;
+        };
+        return perform(url, nullptr, headers, &forward, keepBody);
     }
     
-    // Count matches for deconstructed keywords (LOW value)
-    int expandedMatches = 0;
-    for (const string& kw : expandedKeywordList) {
-        if (lowerAbstract.find(kw) != string::npos) {
-            expandedMatches++;
-        }
+    // Function to POST a request, handing each chunk of a 200 response body to onData as it arrives
+    // onData returns false once it has what it needs; the transfer is then abandoned (closing the connection)
+    // and the response still counts as successful. Error bodies are collected as usual.
+    HttpResponse postStreaming(const string& url, const string& body, const function<bool(string_view)>& onData,
+                               const vector<string>& headers = {}) {
+        return perform(url, &body, headers, &onData, false);
     }
     
-    // NEW: Bonus multiplier for matching MORE keywords
-    // Base score calculation
-    double originalScore = (static_cast<double>(originalMatches) / originalKeywordList.size()) * 100.0;
+private:
+    CURLSH* share;
+    mutex shareLocks[CURL_LOCK_DATA_LAST];
+    mutex poolMutex;
+    vector<CURL*> idleHandles;
     
-    double expandedScore = 0.0;
-    if (!expandedKeywordList.empty()) {
-        expandedScore = (static_cast<double>(expandedMatches) / expandedKeywordList.size()) * 20.0; // Max 20 points
+    static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+        static_cast<HttpClient*>(userptr)->shareLocks[data].lock();
     }
     
-    // Combine base scores
-    double baseScore = originalScore * 0.85 + expandedScore * 0.15;
+    static void unlockShare(CURL*, curl_lock_data data, void* userptr) {
+        static_cast<HttpClient*>(userptr)->shareLocks[data].unlock();
+    }
     
-    // Apply multiplier bonus for matching multiple original keywords
-    // 1 keyword matched = 1.0x, 2 = 1.1x, 3 = 1.2x, 4+ = 1.3x
-    double matchBonus = 1.0;
-    if (originalMatches >= 4) {
-        matchBonus = 1.3;
-    } else if (originalMatches == 3) {
-        matchBonus = 1.2;
-    } else if (originalMatches == 2) {
-        matchBonus = 1.1;
+    // Function to take an idle handle from the pool, or create one
+    CURL* acquireHandle() {
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (!idleHandles.empty()) {
+                CURL* handle = idleHandles.back();
+                idleHandles.pop_back();
+                // Reset options from the previous request; live connections and caches are kept
+                curl_easy_reset(handle);
+                return handle;
+            }
+        }
+        return curl_easy_init();
     }
     
-    return min(100.0, baseScore * matchBonus);
-}
-
-// Function to calculate relevancy score
-double calculateRelevancyScore(const Article& article, const string& query, const string& originalKeywords, const string& expandedKeywords, int currentYear) {
-    // Adjusted weights to emphasize keyword matching
-    const double KEYWORD_MATCH_WEIGHT = 0.35;  // Direct keyword matching
-    const double COSINE_WEIGHT = 0.30;          // Reduced from 0.60
-    const double RECENCY_WEIGHT = 0.20;         // Same
-    const double CITATION_WEIGHT = 0.10;        // Reduced from 0.15
-    const double LENGTH_WEIGHT = 0.05;          // Same
+    // Function to return a handle to the pool
+    void releaseHandle(CURL* handle) {
+        lock_guard<mutex> lock(poolMutex);
+        idleHandles.push_back(handle);
+    }
     
-    // 1. Keyword Match Score (0-100)
-    // Direct matching of keywords in abstract - prioritizes original keywords heavily
-    double keywordScore = calculateKeywordMatchScore(article, originalKeywords, expandedKeywords);
+    // Where a streaming request delivers its body
+    struct StreamTarget {
+        CURL* curl;
+        HttpResponse* response;
+        const function<bool(string_view)>* onData;
+        bool keepBody;
+        long status = -1;  // Looked up with the first chunk, once the headers are complete
+        bool stopped = false;
+    };
     
-    // 2. Cosine Similarity Score with curve (0-100)
-    double cosineSimilarity = calculateCosineSimilarity(query, article.abstract);
-    double curvedSimilarity = sqrt(cosineSimilarity);
-    double cosineScore = min(100.0, curvedSimilarity * 120.0);
+    // Progress callback of cancellable requests: a nonzero return aborts the transfer
+    static int cancellationCallback(void* cancelled, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+        return static_cast<const atomic<bool>*>(cancelled)->load() ? 1 : 0;
+    }
     
-    // 3. Recency Score (0-100)
-    // Papers from this year get 100, papers from 25 years ago get 0
-    double recencyScore = 0.0;
-    if (article.year > 0) {
-        int yearsOld = currentYear - article.year;
-        recencyScore = max(0.0, 100.0 - (yearsOld * 4.0)); // 4 points per year
+    static size_t streamingWriteCallback(char* data, size_t size, size_t nmemb, StreamTarget* target) {
+        size_t length = size * nmemb;
+        if (target->status < 0) {
+            curl_easy_getinfo(target->curl, CURLINFO_RESPONSE_CODE, &target->status);
+        }
+        if (target->status == 200) {
+            if (!(*target->onData)(string_view(data, length))) {
+                target->stopped = true;
+                return 0;  // Anything but length makes curl abort the transfer
+            }
+            if (!target->keepBody) {
+                return length;
+            }
+        }
+        target->response->body.append(data, length);
+        return length;
     }
     
-    // 4. Citation Score (0-100)
-    // Using logarithmic scale, capped at 1000 citations, more generous
-    double citationScore = 0.0;
-    if (article.citationCount > 0) {
-        int cappedCitations = min(article.citationCount, 1000);
-        citationScore = (log(cappedCitations + 1) / log(101)) * 100.0;
-        citationScore = min(100.0, citationScore);
+    // Function to perform a GET (body == nullptr) or POST request
+    // With onData, a successful response body is streamed to it instead of (or as well as) being collected
+    HttpResponse perform(const string& url, const string* body, const vector<string>& headers,
+                         const function<bool(string_view)>* onData = nullptr, bool keepBody = true) {
+        HttpResponse response;
+        CURL* curl = acquireHandle();
+        if (!curl) {
+            response.curlCode = CURLE_FAILED_INIT;
+            return response;
+        }
+        
+        StreamTarget streamTarget{curl, &response, onData, keepBody};
+        curl_easy_setopt(curl, CURLOPT_SHARE, share);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        if (onData) {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, streamingWriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &streamTarget);
+        } else {
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        }
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+        curl_easy_setopt(curl, CURLOPT_USERAGENT, "ScientificResearchApp/1.0");
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);  // Required when curl is used from several threads
+        if (activeCancellation) {
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, cancellationCallback);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void*)activeCancellation);
+        }
+        if (body) {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)body->size());
+        }
+        
+        struct curl_slist* headerList = NULL;
+        for (const string& header : headers) {
+            headerList = curl_slist_append(headerList, header.c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+        
+        response.curlCode = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+        if (streamTarget.stopped && response.curlCode == CURLE_WRITE_ERROR) {
+            response.curlCode = CURLE_OK;
+            response.stoppedEarly = true;
+        }
+        
+        // curl reports each phase as the time since the start of the request; store the phase lengths
+        curl_off_t nameLookup = 0, connect = 0, appConnect = 0, startTransfer = 0, total = 0, requestSize = 0;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &nameLookup);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appConnect);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &response.bytesReceived);
+        curl_easy_getinfo(curl, CURLINFO_REQUEST_SIZE, &requestSize);
+        response.dnsSeconds = nameLookup / 1e6;
+        response.connectSeconds = max((curl_off_t)0, connect - nameLookup) / 1e6;
+        response.tlsSeconds = appConnect > 0 ? max((curl_off_t)0, appConnect - connect) / 1e6 : 0.0;
+        response.firstByteSeconds = startTransfer / 1e6;
+        response.totalSeconds = total / 1e6;
+        response.bytesSent = requestSize + (body ? (curl_off_t)body->size() : 0);
+        
+        curl_slist_free_all(headerList);
+        releaseHandle(curl);
+        return response;
+    }
+};
+
+// Function to get the process-wide HTTP client (created on first use)
+HttpClient& sharedHttpClient() {
+    static HttpClient client;
+    return client;
+}
+
+// Wall-clock seconds spent in each stage of one question (stages overlap in pipelined mode)
+// parse and score are part of search and ranking; parse sums the time of every result page
+struct StageTimings {
+    double classify = 0.0;
+    double extract = 0.0;
+    double validate = 0.0;
+    double search = 0.0;
+    double parse = 0.0;
+    double dedup = 0.0;
+    double score = 0.0;
+    double sort = 0.0;
+    double display = 0.0;
+    double total = 0.0;
+};
+
+// Network counters of one API within one question; times are summed over requests
+struct EndpointMetrics {
+    size_t requests = 0;        // HTTP attempts, retries included
+    size_t retries = 0;
+    size_t failures = 0;        // Requests that still failed after retrying
+    size_t cacheHits = 0;       // Calls answered from the response cache without a request
+    size_t stoppedEarly = 0;    // Streamed responses abandoned once the answer was known
+    double bytesReceived = 0.0;
+    double bytesSent = 0.0;
+    double rateLimitWaitSeconds = 0.0;  // Time spent waiting for the rate limiter
+    double dnsSeconds = 0.0;
+    double connectSeconds = 0.0;
+    double tlsSeconds = 0.0;
+    double firstByteSeconds = 0.0;
+    double totalSeconds = 0.0;
+};
+
+// Structure to hold the timers and counters of one question
+struct QueryMetrics {
+    StageTimings timings;
+    map<string, EndpointMetrics> endpoints;  // Keyed by endpoint policy name
+    size_t articlesParsed = 0;
+    size_t duplicatesMerged = 0;        // Near-duplicate articles folded into another before scoring
+    size_t articlesScored = 0;
+    size_t sourcesDropped = 0;          // Article sources that missed the search deadline
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    size_t classifiedLocally = 0;       // Classification answered by the local classifier
+    size_t classifiedByLLM = 0;         // Classification answered by the LLM
+    size_t shadowAgreements = 0;        // Confident local decisions the LLM agreed with (shadow mode)
+    size_t shadowDisagreements = 0;     // Confident local decisions the LLM overruled (shadow mode)
+};
+
+// Metrics of the question the current thread works for (null outside a question)
+thread_local QueryMetrics* activeQueryMetrics = nullptr;
+mutex queryMetricsMutex;  // Guards updates from the several threads that can serve one question
+
+// Makes the current thread report to a question's metrics until the scope ends
+// Allocations made on the thread meanwhile are added to the question. Open one at every thread
+// entry point that works for a question (runConcurrently does this for its workers).
+class QueryMetricsScope {
+public:
+    explicit QueryMetricsScope(QueryMetrics* metrics)
+        : metrics(metrics), previous(activeQueryMetrics),
+          allocationsAtStart(threadAllocationCount), bytesAtStart(threadAllocatedBytes) {
+        activeQueryMetrics = metrics;
     }
     
-    // 5. Abstract Length Score (0-100)
-    // Prefer abstracts between 100-1000 characters (more lenient)
-    double lengthScore = 0.0;
-    int abstractLen = article.abstract.length();
-    if (abstractLen >= 100) {
-        lengthScore = 100.0; // Any substantial abstract gets full points
-    } else if (abstractLen > 0) {
-        lengthScore = (abstractLen / 100.0) * 100.0;
+    ~QueryMetricsScope() {
+        if (metrics) {
+            lock_guard<mutex> lock(queryMetricsMutex);
+            metrics->allocations += threadAllocationCount - allocationsAtStart;
+            metrics->allocatedBytes += threadAllocatedBytes - bytesAtStart;
+        }
+        activeQueryMetrics = previous;
     }
     
-    // Calculate weighted total
-    double totalScore = (keywordScore * KEYWORD_MATCH_WEIGHT) +
-                       (cosineScore * COSINE_WEIGHT) +
-                       (recencyScore * RECENCY_WEIGHT) +
-                       (citationScore * CITATION_WEIGHT) +
-                       (lengthScore * LENGTH_WEIGHT);
+    QueryMetricsScope(const QueryMetricsScope&) = delete;
+    QueryMetricsScope& operator=(const QueryMetricsScope&) = delete;
     
-    return totalScore;
-}
+private:
+    QueryMetrics* metrics;
+    QueryMetrics* previous;
+    uint64_t allocationsAtStart;
+    uint64_t bytesAtStart;
+};
 
-// Function to extract text from JSON response (Groq format)
-string extractTextFromResponse(const string& response) {
-    // Groq uses OpenAI format: {"choices":[{"message":{"content":"text here"}}]}
-    size_t contentPos = response.find("\"content\"");
-    if (contentPos == string::npos) {
-        return "Error: Could not parse response";
+// Function to update the current question's metrics, if the thread works for one
+void updateQueryMetrics(const function<void(QueryMetrics&)>& update) {
+    if (activeQueryMetrics) {
+        lock_guard<mutex> lock(queryMetricsMutex);
+        update(*activeQueryMetrics);
     }
+}
+
+// Token bucket rate limiter: holds up to `capacity` tokens and refills at `refillPerSecond`
+// Callers that cannot be served yet block until enough tokens have refilled, in arrival order
+class TokenBucket {
+public:
+    TokenBucket(double capacity, double refillPerSecond)
+        : capacity(capacity), refillPerSecond(refillPerSecond), tokens(capacity), lastRefill(chrono::steady_clock::now()) {}
     
-    // Find the content after "content": "
-    size_t startQuote = response.find("\"", contentPos + 9);
-    size_t endQuote = startQuote + 1;
-    
-    // Handle escaped quotes in the content
-    while (endQuote < response.length()) {
-        endQuote = response.find("\"", endQuote);
-        if (endQuote == string::npos) {
-            cout << "[DEBUG] Could not find closing quote" << endl;
-            return "Error: Could not extract text from response";
+    // Function to block until `cost` tokens are available, then take them
+    void acquire(double cost) {
+        if (capacity <= 0.0) {
+            return;  // Unlimited
         }
-        // Check if this quote is escaped
-        if (response[endQuote - 1] != '\\') {
-            break;
+        cost = min(cost, capacity);
+        
+        // Only the caller at the head of the queue waits on the bucket itself
+        lock_guard<mutex> queueLock(queueMutex);
+        while (true) {
+            chrono::duration<double> wait;
+            {
+                lock_guard<mutex> lock(stateMutex);
+                refill();
+                if (tokens >= cost) {
+                    tokens -= cost;
+                    return;
+                }
+                wait = chrono::duration<double>((cost - tokens) / refillPerSecond);
+            }
+            this_thread::sleep_for(wait);
         }
-        endQuote++;
     }
     
-    if (startQuote == string::npos || endQuote == string::npos) {
-        cout << "[DEBUG] Could not extract text quotes" << endl;
-        return "Error: Could not extract text from response";
+    // Function to empty the bucket so that nothing is sent for `seconds` (server asked us to back off)
+    void pauseFor(double seconds) {
+        if (capacity <= 0.0) {
+            return;
+        }
+        lock_guard<mutex> lock(stateMutex);
+        refill();
+        tokens = min(tokens, -seconds * refillPerSecond);
     }
     
-    string extractedText = response.substr(startQuote + 1, endQuote - startQuote - 1);
+private:
+    const double capacity;
+    const double refillPerSecond;
+    double tokens;
+    chrono::steady_clock::time_point lastRefill;
+    mutex queueMutex;
+    mutex stateMutex;
     
-    // Clean up escape sequences
-    size_t pos = 0;
-    while ((pos = extractedText.find("\\n", pos)) != string::npos) {
-        extractedText.replace(pos, 2, " ");
+    void refill() {
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        tokens = min(capacity, tokens + chrono::duration<double>(now - lastRefill).count() * refillPerSecond);
+        lastRefill = now;
     }
-    while ((pos = extractedText.find("\\r", pos)) != string::npos) {
-        extractedText.replace(pos, 2, " ");
+};
+
+// Structure to hold the client-side quota and retry policy of one API endpoint
+struct EndpointPolicy {
+    string name;
+    TokenBucket requestBucket;  // One token per request
+    TokenBucket tokenBucket;    // Estimated LLM tokens per request (capacity 0 = not limited)
+    int maxRetries;
+};
+
+// Groq allows 30 requests and 6000 tokens per minute on this model
+EndpointPolicy& groqPolicy() {
+    static EndpointPolicy policy{"Groq", TokenBucket(30, 30 / 60.0), TokenBucket(6000, 6000 / 60.0), 5};
+    return policy;
+}
+
+// Semantic Scholar shares one global limit among all unauthenticated users, so stay well below it
+EndpointPolicy& semanticScholarPolicy() {
+    static EndpointPolicy policy{"Semantic Scholar", TokenBucket(10, 5), TokenBucket(0, 0), 5};
+    return policy;
+}
+
+// OpenAlex allows 10 requests per second
+EndpointPolicy& openAlexPolicy() {
+    static EndpointPolicy policy{"OpenAlex", TokenBucket(10, 10), TokenBucket(0, 0), 5};
+    return policy;
+}
+
+// Function to estimate the number of LLM tokens in a prompt (roughly 4 characters per token)
+double estimatePromptTokens(const string& prompt) {
+    return prompt.size() / 4.0 + 1;
+}
+
+// Function to decide if a failed request is worth retrying
+bool isRetryableResponse(const HttpResponse& response) {
+    switch (response.curlCode) {
+        case CURLE_OK:
+            return response.status == 429 || response.status == 500 || response.status == 502 ||
+                   response.status == 503 || response.status == 504;
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
     }
-    while ((pos = extractedText.find("\\\"", pos)) != string::npos) {
-        extractedText.replace(pos, 2, "\"");
+}
+
+// Function to get the delay (in seconds) requested by a Retry-After header, or -1 if there is none
+double parseRetryAfter(const string& retryAfter) {
+    if (retryAfter.empty()) {
+        return -1.0;
     }
-    
-    // Trim whitespace
-    extractedText.erase(0, extractedText.find_first_not_of(" \t\n\r"));
-    extractedText.erase(extractedText.find_last_not_of(" \t\n\r") + 1);
-    
-    return extractedText;
+    double seconds;
+    from_chars_result parsed = from_chars(retryAfter.data(), retryAfter.data() + retryAfter.size(), seconds);
+    if (parsed.ec == errc() && parsed.ptr == retryAfter.data() + retryAfter.size()) {
+        return max(0.0, seconds);
+    }
+    // Otherwise it is an HTTP date
+    time_t when = curl_getdate(retryAfter.c_str(), NULL);
+    if (when < 0) {
+        return -1.0;
+    }
+    return max(0.0, difftime(when, time(0)));
 }
 
-// Function to call Groq API
-string callGroqAPI(const string& prompt) {
-    CURL* curl;
-    CURLcode res;
-    string responseString;
-    
-    // Create JSON request body in OpenAI format
-    // Using llama-3.1-70b-versatile model (fast and capable)
-    string jsonData = "{"
-                     "\"model\":\"llama-3.1-8b-instant\","
-                     "\"messages\":[{\"role\":\"user\",\"content\":\"" + escapeJson(prompt) + "\"}],"
-                     "\"temperature\":0.3,"
-                     "\"max_tokens\":500"
-                     "}";
+// Function to send a request through an endpoint's rate limiter, retrying with jittered backoff
+// Requests wait in the limiter's queue instead of failing; on HTTP 429 the whole endpoint pauses
+HttpResponse performWithRetry(EndpointPolicy& policy, double tokenCost, const function<HttpResponse()>& request) {
+    static thread_local mt19937 random(random_device{}());
+    const double BASE_DELAY_SECONDS = 1.0;
+    const double MAX_DELAY_SECONDS = 30.0;
     
-    curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, GROQ_API_URL.c_str());
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonData.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseString);
+    HttpResponse response;
+    for (int attempt = 0; ; attempt++) {
+        chrono::steady_clock::time_point waitStart = chrono::steady_clock::now();
+        policy.requestBucket.acquire(1);
+        policy.tokenBucket.acquire(tokenCost);
+        double waited = chrono::duration<double>(chrono::steady_clock::now() - waitStart).count();
         
-        // Set headers with API key
-        struct curl_slist* headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        string authHeader = "Authorization: Bearer " + GROQ_API_KEY;
-        headers = curl_slist_append(headers, authHeader.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        // An abandoned search sends nothing more
+        if (searchCancelled()) {
+            response = HttpResponse();
+            response.curlCode = CURLE_ABORTED_BY_CALLBACK;
+            return response;
+        }
         
-        res = curl_easy_perform(curl);
+        response = request();
+        bool done = !isRetryableResponse(response) || attempt >= policy.maxRetries || searchCancelled();
+        updateQueryMetrics([&](QueryMetrics& metrics) {
+            EndpointMetrics& endpoint = metrics.endpoints[policy.name];
+            endpoint.requests++;
+            endpoint.retries += attempt > 0;
+            endpoint.failures += done && (response.curlCode != CURLE_OK || response.status >= 400);
+            endpoint.stoppedEarly += response.stoppedEarly;
+            endpoint.bytesReceived += response.bytesReceived;
+            endpoint.bytesSent += response.bytesSent;
+            endpoint.rateLimitWaitSeconds += waited;
+            endpoint.dnsSeconds += response.dnsSeconds;
+            endpoint.connectSeconds += response.connectSeconds;
+            endpoint.tlsSeconds += response.tlsSeconds;
+            endpoint.firstByteSeconds += response.firstByteSeconds;
+            endpoint.totalSeconds += response.totalSeconds;
+        });
+        if (done) {
+            return response;
+        }
         
-        if (res != CURLE_OK) {
-            cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << endl;
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
-            return "Error: API call failed";
+        // Exponential backoff with full jitter, unless the server told us how long to wait
+        double delay = uniform_real_distribution<double>(0.0, min(MAX_DELAY_SECONDS, BASE_DELAY_SECONDS * (1 << attempt)))(random);
+        double retryAfter = parseRetryAfter(response.retryAfter);
+        if (retryAfter >= 0.0) {
+            delay = retryAfter + uniform_real_distribution<double>(0.0, 0.5)(random);
+        }
+        if (response.status == 429) {
+            policy.requestBucket.pauseFor(delay);
         }
         
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
+        cerr << "[" << policy.name << "] "
+             << (response.curlCode == CURLE_OK ? "HTTP " + to_string(response.status) : string(curl_easy_strerror(response.curlCode)))
+             << ", retrying in " << fixed << setprecision(1) << delay << "s (attempt " << (attempt + 1) << " of " << policy.maxRetries << ")" << endl;
         
-        return extractTextFromResponse(responseString);
+        // Sleep in short slices so that an abandoned search stops waiting right away
+        chrono::steady_clock::time_point wakeUp = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(delay));
+        while (!searchCancelled() && chrono::steady_clock::now() < wakeUp) {
+            this_thread::sleep_for(min<chrono::steady_clock::duration>(wakeUp - chrono::steady_clock::now(), chrono::milliseconds(50)));
+        }
+    }
+}
+
+// Function to escape JSON strings
+string escapeJson(const string& input) {
+    string output;
+    for (char c : input) {
+        switch (c) {
+            case '"': output += "\\\""; break;
+            case '\\': output += "\\\\"; break;
+            case '\b': output += "\\b"; break;
+            case '\f': output += "\\f"; break;
+            case '\n': output += "\\n"; break;
+            case '\r': output += "\\r"; break;
+            case '\t': output += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    output += escaped;
+                } else {
+                    output += c;
+                }
+                break;
+        }
+    }
+    return output;
+}
+
+// Function to URL encode a string
+string urlEncode(const string& str) {
+    ostringstream escaped;
+    escaped.fill('0');
+    escaped << hex;
+
+    for (char c : str) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            escaped << c;
+        } else if (c == ' ') {
+            escaped << '+';
+        } else {
+            escaped << '%' << setw(2) << int((unsigned char)c);
+        }
+    }
+
+    return escaped.str();
+}
+
+// Function to convert string to lowercase
+string toLowercase(string str) {
+    transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+// Function to hash a term (64-bit FNV-1a)
+uint64_t hashTerm(string_view term) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : term) {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Reusable buffers for tokenizing: the case-folded copy of the text and the tokens, which point into it
+// Reusing one per thread means tokenizing allocates nothing once the buffers have grown
+struct TokenBuffer {
+    string folded;
+    vector<string_view> tokens;
+};
+
+// Token bytes are ASCII letters and digits; this maps each of them to its lowercase form and every other byte to 0
+const array<char, 256>& tokenByteTable() {
+    static const array<char, 256> table = []() {
+        array<char, 256> bytes = {};
+        for (int c = '0'; c <= '9'; c++) bytes[c] = (char)c;
+        for (int c = 'a'; c <= 'z'; c++) bytes[c] = (char)c;
+        for (int c = 'A'; c <= 'Z'; c++) bytes[c] = (char)(c - 'A' + 'a');
+        return bytes;
+    }();
+    return table;
+}
+
+// Function to turn one block's token-byte mask (bit i set if byte i is a token byte) into tokens
+// Only bytes where the mask flips from the previous byte start or end a token, so long words and long
+// separator runs cost nothing beyond the block test
+inline void collectTokenRuns(uint64_t mask, size_t blockStart, size_t blockSize, bool& inToken, size_t& tokenStart,
+                             TokenBuffer& buffer) {
+    uint64_t full = blockSize == 64 ? ~0ULL : (1ULL << blockSize) - 1;
+    if (mask == (inToken ? full : 0)) {
+        return;
+    }
+    uint64_t changes = (mask ^ ((mask << 1) | (inToken ? 1 : 0))) & full;
+    while (changes) {
+        size_t pos = blockStart + __builtin_ctzll(changes);
+        if (inToken) {
+            buffer.tokens.emplace_back(buffer.folded.data() + tokenStart, pos - tokenStart);
+        } else {
+            tokenStart = pos;
+        }
+        inToken = !inToken;
+        changes &= changes - 1;
+    }
+}
+
+// Function to fold and classify bytes [start, end) with the lookup table, 64 at a time
+inline void tokenizeBlocksScalar(string_view text, size_t start, size_t end, bool& inToken, size_t& tokenStart,
+                                 TokenBuffer& buffer) {
+    const array<char, 256>& table = tokenByteTable();
+    const unsigned char* in = (const unsigned char*)text.data();
+    char* out = &buffer.folded[0];
+    for (size_t block = start; block < end; block += 64) {
+        size_t blockSize = min((size_t)64, end - block);
+        uint64_t mask = 0;
+        for (size_t i = 0; i < blockSize; i++) {
+            char folded = table[in[block + i]];
+            out[block + i] = folded;
+            mask |= (uint64_t)(folded != 0) << i;
+        }
+        collectTokenRuns(mask, block, blockSize, inToken, tokenStart, buffer);
+    }
+}
+
+// Function to split text into lowercase alphanumeric words without SIMD (the reference the SIMD path must match)
+void tokenizeScalar(string_view text, TokenBuffer& buffer) {
+    buffer.folded.resize(text.size());
+    buffer.tokens.clear();
+    bool inToken = false;
+    size_t tokenStart = 0;
+    tokenizeBlocksScalar(text, 0, text.size(), inToken, tokenStart, buffer);
+    if (inToken) {
+        buffer.tokens.emplace_back(buffer.folded.data() + tokenStart, text.size() - tokenStart);
+    }
+}
+
+// Function to split text into lowercase alphanumeric words, as views into buffer.folded
+// Bytes are classified and case-folded 32 (AVX2) or 16 (SSE2) at a time with compare masks; the tail,
+// and builds for other targets, use the lookup table. Output is identical either way.
+void tokenizeInto(string_view text, TokenBuffer& buffer) {
+    buffer.folded.resize(text.size());
+    buffer.tokens.clear();
+    bool inToken = false;
+    size_t tokenStart = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i letterBias = _mm256_set1_epi8((char)(128 - 'a'));
+    const __m256i letterLimit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i digitBias = _mm256_set1_epi8((char)(128 - '0'));
+    const __m256i digitLimit = _mm256_set1_epi8((char)(-128 + 10));
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    for (; i + 32 <= text.size(); i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(text.data() + i));
+        // OR-ing in 0x20 maps A-Z onto a-z and nothing else onto a-z; a signed compare after shifting the
+        // range to start at -128 is an unsigned range check
+        __m256i lowered = _mm256_or_si256(bytes, caseBit);
+        __m256i isLetter = _mm256_cmpgt_epi8(letterLimit, _mm256_add_epi8(lowered, letterBias));
+        __m256i isDigit = _mm256_cmpgt_epi8(digitLimit, _mm256_add_epi8(bytes, digitBias));
+        __m256i folded = _mm256_or_si256(bytes, _mm256_and_si256(isLetter, caseBit));
+        _mm256_storeu_si256((__m256i*)&buffer.folded[i], folded);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isLetter, isDigit));
+        collectTokenRuns(mask, i, 32, inToken, tokenStart, buffer);
+    }
+#elif defined(__SSE2__)
+    const __m128i letterBias = _mm_set1_epi8((char)(128 - 'a'));
+    const __m128i letterLimit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i digitBias = _mm_set1_epi8((char)(128 - '0'));
+    const __m128i digitLimit = _mm_set1_epi8((char)(-128 + 10));
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= text.size(); i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(text.data() + i));
+        // OR-ing in 0x20 maps A-Z onto a-z and nothing else onto a-z; a signed compare after shifting the
+        // range to start at -128 is an unsigned range check
+        __m128i lowered = _mm_or_si128(bytes, caseBit);
+        __m128i isLetter = _mm_cmplt_epi8(_mm_add_epi8(lowered, letterBias), letterLimit);
+        __m128i isDigit = _mm_cmplt_epi8(_mm_add_epi8(bytes, digitBias), digitLimit);
+        __m128i folded = _mm_or_si128(bytes, _mm_and_si128(isLetter, caseBit));
+        _mm_storeu_si128((__m128i*)&buffer.folded[i], folded);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(isLetter, isDigit));
+        collectTokenRuns(mask, i, 16, inToken, tokenStart, buffer);
+    }
+#endif
+    tokenizeBlocksScalar(text, i, text.size(), inToken, tokenStart, buffer);
+    if (inToken) {
+        buffer.tokens.emplace_back(buffer.folded.data() + tokenStart, text.size() - tokenStart);
+    }
+}
+
+// Function to hash every token of a text, in text order, into hashes (replacing its contents)
+void tokenHashes(string_view text, vector<uint64_t>& hashes) {
+    thread_local TokenBuffer buffer;
+    tokenizeInto(text, buffer);
+    hashes.clear();
+    for (string_view token : buffer.tokens) {
+        hashes.push_back(hashTerm(token));
+    }
+}
+
+// Function to tokenize text into words
+vector<string> tokenize(string_view text) {
+    TokenBuffer buffer;
+    tokenizeInto(text, buffer);
+    return vector<string>(buffer.tokens.begin(), buffer.tokens.end());
+}
+
+// Dense text embeddings: words and their character trigrams are hashed into a fixed number of signed
+// dimensions, and the sums are quantized to int8. No model is needed, and similarity is one integer dot product.
+const size_t EMBEDDING_DIMENSIONS = 256;
+const float EMBEDDING_TRIGRAM_WEIGHT = 0.5f;  // Per character trigram, against 1 per word
+
+struct Embedding {
+    int8_t values[EMBEDDING_DIMENSIONS];  // In [-127, 127], so the SIMD products below cannot saturate
+    float norm;                           // Euclidean norm of values, 0 for a text without tokens
+};
+
+// Function to add a hashed feature to an embedding accumulator (the hash picks the dimension and the sign)
+inline void addEmbeddingFeature(float* sums, uint64_t hash, float weight) {
+    hash ^= hash >> 29;
+    sums[hash & (EMBEDDING_DIMENSIONS - 1)] += (hash >> 63) ? -weight : weight;
+}
+
+// Function to embed a text from its tokens and their character trigrams (tokens padded with '<' and '>')
+Embedding computeEmbedding(string_view text) {
+    thread_local TokenBuffer buffer;
+    tokenizeInto(text, buffer);
+    
+    float sums[EMBEDDING_DIMENSIONS] = {};
+    for (string_view token : buffer.tokens) {
+        addEmbeddingFeature(sums, hashTerm(token), 1.0f);
+        for (size_t i = 0; i < token.size(); i++) {
+            // The trigram centred on token[i], with the padding standing in beyond either end
+            unsigned char trigram[3] = {(unsigned char)(i == 0 ? '<' : token[i - 1]), (unsigned char)token[i],
+                                        (unsigned char)(i + 1 < token.size() ? token[i + 1] : '>')};
+            uint64_t hash = 0x84222325cbf29ce4ULL;  // Differs from hashTerm's basis, so trigrams and words do not collide
+            for (unsigned char c : trigram) {
+                hash ^= c;
+                hash *= 1099511628211ULL;
+            }
+            addEmbeddingFeature(sums, hash, EMBEDDING_TRIGRAM_WEIGHT);
+        }
     }
     
-    return "Error: Failed to initialize curl";
+    Embedding embedding;
+    float maxMagnitude = 0.0f;
+    for (float sum : sums) {
+        maxMagnitude = max(maxMagnitude, fabs(sum));
+    }
+    float scale = maxMagnitude > 0.0f ? 127.0f / maxMagnitude : 0.0f;
+    int32_t squares = 0;
+    for (size_t d = 0; d < EMBEDDING_DIMENSIONS; d++) {
+        int value = (int)lrintf(sums[d] * scale);
+        embedding.values[d] = (int8_t)max(-127, min(127, value));
+        squares += embedding.values[d] * embedding.values[d];
+    }
+    embedding.norm = sqrt((float)squares);
+    return embedding;
 }
 
-// Function to check if question is scientific using Groq
-bool isScientificQuestion(const string& question) {
-    string prompt = "You are an expert query classifier whose job is to differentiate\n"
-                   "scientific queries/questions from general run-of-the-mill questions.\n\n"
-                   "A \"Scientific\" query inquires about natural phenomena, technology, engineering, medicine, mathematics, or formal science. It often seeks to understand how or why something works.\n"
-                   "It is the type of enquiry that requires support to strengthen its position, such as research and studies.\n\n"
-                   "A \"Not_Scientific\" query asks for simple facts, directions, recipes, opinions, news, sports scores, or personal advice. These types of enquiries often are\n"
-                   "quick and easy, not needed to be supported by any research or studies.\n\n"
-                   "-- EXAMPLES --\n"
-                   "Query: how do electromagnetic circuits work?\n"
-                   "Classification: Scientific\n\n"
-                   "Query: use of artificial intelligence in EVs\n"
-                   "Classification: Scientific\n\n"
-                   "Query: what is the weather today?\n"
-                   "Classification: Not_Scientific\n\n"
-                   "Query: how to cook an egg\n"
-                   "Classification: Not_Scientific\n\n"
-                   "Query: what were the football scores last night?\n"
-                   "Classification: Not_Scientific\n"
-                   "-- END EXAMPLES --\n\n"
-                   "Now, classify the following query. Respond with ONLY one word: Scientific or Not_Scientific.\n\n"
-                   "Query: " + question + "\n"
-                   "Classification:";
+// Function to take the dot product of two embeddings
+// AVX-VNNI / AVX-512 VNNI multiply-accumulate bytes straight into 32-bit sums; plain AVX2 goes through
+// 16-bit pairs. Both take the sign of a onto b so the unsigned-by-signed instructions apply.
+inline int32_t embeddingDotProduct(const Embedding& a, const Embedding& b) {
+#if defined(__AVX2__)
+    __m256i sums = _mm256_setzero_si256();
+#if !defined(__AVXVNNI__) && !(defined(__AVX512VNNI__) && defined(__AVX512VL__))
+    const __m256i ones = _mm256_set1_epi16(1);
+#endif
+    for (size_t d = 0; d < EMBEDDING_DIMENSIONS; d += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a.values + d));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b.values + d));
+        __m256i magnitudes = _mm256_abs_epi8(x);
+        __m256i signedY = _mm256_sign_epi8(y, x);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+        sums = _mm256_dpbusd_epi32(sums, magnitudes, signedY);
+#elif defined(__AVXVNNI__)
+        sums = _mm256_dpbusd_avx_epi32(sums, magnitudes, signedY);
+#else
+        sums = _mm256_add_epi32(sums, _mm256_madd_epi16(_mm256_maddubs_epi16(magnitudes, signedY), ones));
+#endif
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+#else
+    int32_t sum = 0;
+    for (size_t d = 0; d < EMBEDDING_DIMENSIONS; d++) {
+        sum += a.values[d] * b.values[d];
+    }
+    return sum;
+#endif
+}
+
+// Function to get the cosine similarity of two embeddings (0 if either is empty)
+inline double embeddingSimilarity(const Embedding& a, const Embedding& b) {
+    if (a.norm == 0.0f || b.norm == 0.0f) {
+        return 0.0;
+    }
+    return embeddingDotProduct(a, b) / ((double)a.norm * b.norm);
+}
+
+// Structure to hold a sparse term vector as (term hash, weight) pairs sorted by hash
+struct SparseVector {
+    vector<pair<uint64_t, double>> terms;
+    double norm = 0.0;
+};
+
+// Structure to hold a compiled multi-pattern (Aho-Corasick) keyword matcher
+// Matching is case-insensitive: upper and lower case letters map to the same alphabet class
+struct KeywordMatcher {
+    int alphabetSize = 1;                 // Class 0 stands for every byte that appears in no keyword
+    unsigned char byteClass[256] = {};    // Byte -> alphabet class
+    vector<int> transitions;              // Full goto table, state * alphabetSize + class -> next state
+    vector<int> outputStart;              // Per state, start of its range in outputKeywords (size = states + 1)
+    vector<int> outputKeywords;           // Keyword indices ending at each state, including suffix matches
+    size_t keywordCount = 0;
+};
+
+// Text similarity component used in the relevancy score
+enum SimilarityScorer {
+    SCORER_COSINE,  // Cosine similarity of raw term frequencies
+    SCORER_BM25,    // BM25 with document frequencies from the local corpus
+    SCORER_EMBEDDING  // Cosine similarity of hashed n-gram embeddings
+};
+
+// Structure to hold everything scoring needs about one query, built once and shared by all articles
+struct QueryContext {
+    SparseVector queryVector;            // Hashed TF vector of the question with its norm precomputed
+    vector<string> originalKeywordList;  // Lowercased original keywords (HIGH value)
+    vector<string> expandedKeywordList;  // Lowercased expanded keywords not in the original list (LOW value)
+    KeywordMatcher keywordMatcher;       // Original keywords are indices [0, n), expanded ones follow
     
-    string response = callGroqAPI(prompt);
+    SimilarityScorer scorer = SCORER_COSINE;
+    vector<pair<uint64_t, double>> queryTermIdf;  // BM25: distinct question terms with their IDF, sorted by hash
+    double averageDocumentLength = 0.0;           // BM25: average abstract length in tokens across the corpus
+    Embedding queryEmbedding = {};                // Embedding: the question's vector
+};
+
+// Function to calculate term frequency as a sparse hashed vector from the token hashes of a text
+// (the hashes are sorted in place)
+SparseVector calculateTF(vector<uint64_t>& hashes) {
+    SparseVector tf;
+    if (hashes.empty()) {
+        return tf;
+    }
+    sort(hashes.begin(), hashes.end());
     
-    if (response.find("Scientific") != string::npos) {
-        if (response.find("Not_Scientific") != string::npos) {
-            return false;
+    // Collapse runs of equal hashes into counts, normalized by total number of tokens
+    double total = hashes.size();
+    for (size_t i = 0; i < hashes.size();) {
+        size_t j = i;
+        while (j < hashes.size() && hashes[j] == hashes[i]) j++;
+        double weight = (j - i) / total;
+        tf.terms.push_back({hashes[i], weight});
+        tf.norm += weight * weight;
+        i = j;
+    }
+    tf.norm = sqrt(tf.norm);
+    
+    return tf;
+}
+
+// Function to compile keywords (already lowercased) into an Aho-Corasick automaton
+KeywordMatcher buildKeywordMatcher(const vector<string>& keywords) {
+    KeywordMatcher matcher;
+    matcher.keywordCount = keywords.size();
+    
+    // Give every byte used by a keyword its own class, folding A-Z onto a-z
+    for (const string& kw : keywords) {
+        for (char c : kw) {
+            unsigned char b = (unsigned char)c;
+            if (matcher.byteClass[b] == 0) {
+                matcher.byteClass[b] = (unsigned char)matcher.alphabetSize++;
+            }
         }
-        return true;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+        matcher.byteClass[c] = matcher.byteClass[c - 'A' + 'a'];
     }
     
-    return false;
+    // Build the trie (-1 = no edge yet), remembering which keywords end where
+    int alphabetSize = matcher.alphabetSize;
+    vector<int>& next = matcher.transitions;
+    vector<vector<int>> ends(1);
+    next.assign(alphabetSize, -1);
+    for (size_t k = 0; k < keywords.size(); k++) {
+        int state = 0;
+        for (char c : keywords[k]) {
+            int cls = matcher.byteClass[(unsigned char)c];
+            if (next[state * alphabetSize + cls] < 0) {
+                next[state * alphabetSize + cls] = (int)ends.size();
+                next.resize(next.size() + alphabetSize, -1);
+                ends.emplace_back();
+            }
+            state = next[state * alphabetSize + cls];
+        }
+        ends[state].push_back((int)k);
+    }
+    
+    // Breadth-first pass: fill missing edges from failure links and inherit their outputs
+    vector<int> fail(ends.size(), 0);
+    vector<int> queue;
+    for (int cls = 0; cls < alphabetSize; cls++) {
+        int child = next[cls];
+        if (child < 0) {
+            next[cls] = 0;
+        } else {
+            queue.push_back(child);
+        }
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+        int state = queue[head];
+        const vector<int>& inherited = ends[fail[state]];
+        ends[state].insert(ends[state].end(), inherited.begin(), inherited.end());
+        for (int cls = 0; cls < alphabetSize; cls++) {
+            int child = next[state * alphabetSize + cls];
+            int fallback = next[fail[state] * alphabetSize + cls];
+            if (child < 0) {
+                next[state * alphabetSize + cls] = fallback;
+            } else {
+                fail[child] = fallback;
+                queue.push_back(child);
+            }
+        }
+    }
+    
+    // Flatten outputs so scanning does not chase pointers
+    matcher.outputStart.push_back(0);
+    for (const vector<int>& out : ends) {
+        matcher.outputKeywords.insert(matcher.outputKeywords.end(), out.begin(), out.end());
+        matcher.outputStart.push_back((int)matcher.outputKeywords.size());
+    }
+    
+    return matcher;
 }
 
-// Function to validate keywords and query using Groq
-string validateQueryWithGroq(const string& question, const string& keywords) {
-    string prompt = "You are an expert in scientific research and query validation.\n"
-                   "Your task is to determine if a research question and its keywords are valid.\n\n"
-                   "A query is INVALID if:\n"
-                   "1. The keywords are completely nonsensical or unrelated to each other\n"
-                   "2. The keywords don't match the query at all\n"
-                   "3. The query is just a list of keywords/topics rather than an actual question or research statement\n"
-                   "4. The concepts are contradictory or impossible (e.g., 'flat earth physics in spherical geometry')\n\n"
-                   "A query is VALID if:\n"
-                   "1. It's a proper question, statement, or research topic (not just keywords)\n"
-                   "2. The keywords are coherent and scientifically related\n"
-                   "3. The keywords match the intent of the query\n\n"
-                   "Respond with ONLY one word: VALID or INVALID\n\n"
-                   "-- EXAMPLES --\n"
-                   "Query: What is the impact of artificial intelligence on healthcare diagnostics?\n"
-                   "Keywords: artificial intelligence, healthcare diagnostics\n"
-                   "Response: VALID\n\n"
-                   "Query: How does quantum entanglement work in quantum computing?\n"
-                   "Keywords: quantum entanglement, quantum computing\n"
-                   "Response: VALID\n\n"
-                   "Query: artificial intelligence, healthcare, technology\n"
-                   "Keywords: artificial intelligence, healthcare, technology\n"
-                   "Response: INVALID\n\n"
-                   "Query: Purple elephants dancing with nuclear submarines\n"
-                   "Keywords: purple elephants, nuclear submarines\n"
-                   "Response: INVALID\n\n"
-                   "Query: Impact of Shakespeare on quantum mechanics\n"
-                   "Keywords: Shakespeare, quantum mechanics\n"
-                   "Response: INVALID\n"
-                   "-- END EXAMPLES --\n\n"
-                   "Now, validate the following.\n\n"
-                   "Query: " + question + "\n"
-                   "Keywords: " + keywords + "\n"
-                   "Response:";
+// Function to mark which keywords occur in a text, in a single pass over it
+// Returns the number of distinct keywords found
+size_t findKeywordMatches(const KeywordMatcher& matcher, string_view text, vector<char>& found) {
+    found.assign(matcher.keywordCount, 0);
+    if (matcher.keywordCount == 0) {
+        return 0;
+    }
+    
+    size_t foundCount = 0;
+    int state = 0;
+    const int* next = matcher.transitions.data();
+    const int alphabetSize = matcher.alphabetSize;
+    for (char c : text) {
+        state = next[state * alphabetSize + matcher.byteClass[(unsigned char)c]];
+        for (int i = matcher.outputStart[state]; i < matcher.outputStart[state + 1]; i++) {
+            int kw = matcher.outputKeywords[i];
+            if (!found[kw]) {
+                found[kw] = 1;
+                // Stop early once every keyword has been seen
+                if (++foundCount == matcher.keywordCount) {
+                    return foundCount;
+                }
+            }
+        }
+    }
     
-    return callGroqAPI(prompt);
+    return foundCount;
 }
 
-// Function to expand keywords (keep full phrases + split into individual words)
-string expandKeywords(const string& keywords) {
-    vector<string> expandedKeywords;
+// Function to split a comma-separated keyword string into trimmed, lowercased keywords
+vector<string> parseKeywordList(const string& keywords) {
+    vector<string> keywordList;
     istringstream ss(keywords);
     string keyword;
     
-    // Split by commas to get individual keywords/phrases
-    while (getline(ss, keyword, ',')) {
-        // Trim whitespace
-        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
-        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
+    while (getline(ss, keyword, ',')) {
+        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
+        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
+        if (!keyword.empty()) {
+            keywordList.push_back(toLowercase(keyword));
+        }
+    }
+    
+    return keywordList;
+}
+
+// Function to build the per-query scoring context (done once, not once per article)
+QueryContext buildQueryContext(const string& query, const string& originalKeywords, const string& expandedKeywords) {
+    QueryContext context;
+    vector<uint64_t> queryHashes;
+    tokenHashes(query, queryHashes);
+    context.queryVector = calculateTF(queryHashes);
+    context.originalKeywordList = parseKeywordList(originalKeywords);
+    
+    // Only keep expanded keywords NOT in the original list (these are the deconstructed words)
+    for (string& kw : parseKeywordList(expandedKeywords)) {
+        if (find(context.originalKeywordList.begin(), context.originalKeywordList.end(), kw) == context.originalKeywordList.end()) {
+            context.expandedKeywordList.push_back(move(kw));
+        }
+    }
+    
+    vector<string> allKeywords = context.originalKeywordList;
+    allKeywords.insert(allKeywords.end(), context.expandedKeywordList.begin(), context.expandedKeywordList.end());
+    context.keywordMatcher = buildKeywordMatcher(allKeywords);
+    
+    return context;
+}
+
+// Function to calculate cosine similarity between the query and a text
+// The text's term frequencies are walked straight off its sorted token hashes, without building a vector
+double calculateCosineSimilarity(const QueryContext& context, string_view text) {
+    const SparseVector& queryTF = context.queryVector;
+    if (queryTF.terms.empty()) {
+        return 0.0;
+    }
+    
+    thread_local vector<uint64_t> hashes;
+    tokenHashes(text, hashes);
+    if (hashes.empty()) {
+        return 0.0;
+    }
+    sort(hashes.begin(), hashes.end());
+    
+    // Both sides are sorted by hash, so the dot product is a single merge pass over runs of equal hashes
+    double total = hashes.size();
+    double dotProduct = 0.0;
+    double textNorm = 0.0;
+    size_t i = 0;
+    for (size_t j = 0; j < hashes.size();) {
+        size_t runEnd = j;
+        while (runEnd < hashes.size() && hashes[runEnd] == hashes[j]) runEnd++;
+        double weight = (runEnd - j) / total;
+        textNorm += weight * weight;
+        while (i < queryTF.terms.size() && queryTF.terms[i].first < hashes[j]) {
+            i++;
+        }
+        if (i < queryTF.terms.size() && queryTF.terms[i].first == hashes[j]) {
+            dotProduct += queryTF.terms[i].second * weight;
+            i++;
+        }
+        j = runEnd;
+    }
+    textNorm = sqrt(textNorm);
+    
+    if (queryTF.norm == 0.0 || textNorm == 0.0) {
+        return 0.0;
+    }
+    
+    return dotProduct / (queryTF.norm * textNorm);
+}
+
+// Function to calculate the BM25 score of a text against the question, normalized to 0-1
+// The score is divided by its upper bound (every query term saturated), so it is comparable across queries
+double calculateBM25Score(const QueryContext& context, string_view text) {
+    const double K1 = 1.2;
+    const double B = 0.75;
+    
+    if (context.queryTermIdf.empty() || context.averageDocumentLength <= 0.0) {
+        return 0.0;
+    }
+    
+    thread_local vector<uint64_t> hashes;
+    tokenHashes(text, hashes);
+    if (hashes.empty()) {
+        return 0.0;
+    }
+    sort(hashes.begin(), hashes.end());
+    
+    double lengthNorm = K1 * (1.0 - B + B * hashes.size() / context.averageDocumentLength);
+    double score = 0.0;
+    double maxScore = 0.0;
+    for (const auto& term : context.queryTermIdf) {
+        auto range = equal_range(hashes.begin(), hashes.end(), term.first);
+        double tf = range.second - range.first;
+        score += term.second * tf * (K1 + 1.0) / (tf + lengthNorm);
+        maxScore += term.second * (K1 + 1.0);
+    }
+    
+    return maxScore > 0.0 ? score / maxScore : 0.0;
+}
+
+// Function to calculate the similarity component (0-100) from an article's embedding
+// Embedding similarity of unrelated texts sits near 0, so it is used linearly without the cosine curve
+inline double calculateEmbeddingScore(const QueryContext& context, const Embedding& embedding) {
+    return min(100.0, max(0.0, embeddingSimilarity(context.queryEmbedding, embedding)) * 100.0);
+}
+
+// Function to calculate the text similarity component of the relevancy score (0-100)
+double calculateSimilarityScore(const QueryContext& context, string_view text) {
+    if (context.scorer == SCORER_BM25) {
+        return min(100.0, calculateBM25Score(context, text) * 100.0);
+    }
+    if (context.scorer == SCORER_EMBEDDING) {
+        return calculateEmbeddingScore(context, computeEmbedding(text));
+    }
+    
+    // Cosine similarity with curve
+    double cosineSimilarity = calculateCosineSimilarity(context, text);
+    double curvedSimilarity = sqrt(cosineSimilarity);
+    return min(100.0, curvedSimilarity * 120.0);
+}
+
+// Function to calculate keyword match score
+double calculateKeywordMatchScore(string_view abstract, const QueryContext& context) {
+    if (abstract.empty()) {
+        return 0.0;
+    }
+    
+    const vector<string>& originalKeywordList = context.originalKeywordList;
+    const vector<string>& expandedKeywordList = context.expandedKeywordList;
+    
+    if (originalKeywordList.empty()) {
+        return 0.0;
+    }
+    
+    // Find every keyword in one case-insensitive pass over the abstract (into a per-thread buffer, so that
+    // scoring an article allocates nothing once it has grown)
+    thread_local vector<char> found;
+    findKeywordMatches(context.keywordMatcher, abstract, found);
+    
+    // Count matches for original keywords (HIGH value)
+    int originalMatches = 0;
+    for (size_t i = 0; i < originalKeywordList.size(); i++) {
+        originalMatches += found[i];
+    }
+    
+    // Count matches for deconstructed keywords (LOW value)
+    int expandedMatches = 0;
+    for (size_t i = originalKeywordList.size(); i < found.size(); i++) {
+        expandedMatches += found[i];
+    }
+    
+    // NEW: Bonus multiplier for matching MORE keywords
+    // Base score calculation
+    double originalScore = (static_cast<double>(originalMatches) / originalKeywordList.size()) * 100.0;
+    
+    double expandedScore = 0.0;
+    if (!expandedKeywordList.empty()) {
+        expandedScore = (static_cast<double>(expandedMatches) / expandedKeywordList.size()) * 20.0; // Max 20 points
+    }
+    
+    // Combine base scores
+    double baseScore = originalScore * 0.85 + expandedScore * 0.15;
+    
+    // Apply multiplier bonus for matching multiple original keywords
+    // 1 keyword matched = 1.0x, 2 = 1.1x, 3 = 1.2x, 4+ = 1.3x
+    double matchBonus = 1.0;
+    if (originalMatches >= 4) {
+        matchBonus = 1.3;
+    } else if (originalMatches == 3) {
+        matchBonus = 1.2;
+    } else if (originalMatches == 2) {
+        matchBonus = 1.1;
+    }
+    
+    return min(100.0, baseScore * matchBonus);
+}
+
+double calculateKeywordMatchScore(const Article& article, const QueryContext& context) {
+    return calculateKeywordMatchScore(article.abstract, context);
+}
+
+// Relevancy score weights, adjusted to emphasize keyword matching
+const double KEYWORD_MATCH_WEIGHT = 0.35;  // Direct keyword matching
+const double SIMILARITY_WEIGHT = 0.30;      // Reduced from 0.60
+const double RECENCY_WEIGHT = 0.20;         // Same
+const double CITATION_WEIGHT = 0.10;        // Reduced from 0.15
+const double LENGTH_WEIGHT = 0.05;          // Same
+
+// Function to calculate the recency score (0-100)
+// Papers from this year get 100, papers from 25 years ago get 0
+inline double calculateRecencyScore(int year, int currentYear) {
+    return year > 0 ? max(0.0, 100.0 - ((currentYear - year) * 4.0)) : 0.0; // 4 points per year
+}
+
+// Citation scores for 0-1000 citations (log scale, capped at 1000, more generous)
+// Looked up instead of computed so that scoring a batch needs no call to log()
+const array<double, 1001>& citationScoreTable() {
+    static const array<double, 1001> table = []() {
+        array<double, 1001> scores;
+        scores[0] = 0.0;
+        for (int citations = 1; citations <= 1000; citations++) {
+            scores[citations] = min(100.0, (log(citations + 1) / log(101)) * 100.0);
+        }
+        return scores;
+    }();
+    return table;
+}
+
+// Function to calculate the citation score (0-100)
+inline double calculateCitationScore(int citationCount, const array<double, 1001>& table) {
+    return table[min(max(citationCount, 0), 1000)];
+}
+
+// Function to calculate the abstract length score (0-100)
+// Prefer abstracts between 100-1000 characters (more lenient)
+inline double calculateLengthScore(size_t abstractLength) {
+    if (abstractLength >= 100) {
+        return 100.0; // Any substantial abstract gets full points
+    }
+    return (abstractLength / 100.0) * 100.0;
+}
+
+// Function to calculate relevancy score from an article's fields
+double calculateRelevancyScore(string_view abstract, int year, int citationCount, const QueryContext& context, int currentYear) {
+    // 1. Keyword Match Score (0-100)
+    // Direct matching of keywords in abstract - prioritizes original keywords heavily
+    double keywordScore = calculateKeywordMatchScore(abstract, context);
+    
+    // 2. Text Similarity Score (0-100): curved cosine similarity, or BM25
+    double similarityScore = calculateSimilarityScore(context, abstract);
+    
+    // 3-5. Recency, citation and abstract length scores (0-100)
+    double recencyScore = calculateRecencyScore(year, currentYear);
+    double citationScore = calculateCitationScore(citationCount, citationScoreTable());
+    double lengthScore = calculateLengthScore(abstract.length());
+    
+    // Calculate weighted total
+    double totalScore = (keywordScore * KEYWORD_MATCH_WEIGHT) +
+                       (similarityScore * SIMILARITY_WEIGHT) +
+                       (recencyScore * RECENCY_WEIGHT) +
+                       (citationScore * CITATION_WEIGHT) +
+                       (lengthScore * LENGTH_WEIGHT);
+    
+    return totalScore;
+}
+
+// Function to calculate relevancy score
+double calculateRelevancyScore(const Article& article, const QueryContext& context, int currentYear) {
+    return calculateRelevancyScore(article.abstract, article.year, article.citationCount, context, currentYear);
+}
+
+// Function to calculate the relevancy score of one row of a batch
+double calculateRelevancyScore(const ArticleBatch& batch, size_t row, const QueryContext& context, int currentYear) {
+    return calculateRelevancyScore(batch.abstract(row), batch.years[row], batch.citationCounts[row], context, currentYear);
+}
+
+// Function to score every row of a batch into batch.scores
+// The text components are computed per row; the numeric ones then run as plain loops over the
+// contiguous year, citation and length columns, which the compiler vectorizes. Terms are added in the
+// same order as calculateRelevancyScore, so the scores are identical to scoring row by row.
+// With the embedding scorer, abstractEmbeddings (one per row, e.g. from the corpus cache) replaces
+// embedding each abstract, leaving one dot product per row.
+void scoreArticleBatch(ArticleBatch& batch, const QueryContext& context, int currentYear,
+                       const vector<Embedding>* abstractEmbeddings = nullptr) {
+    size_t count = batch.size();
+    vector<double>& scores = batch.scores;
+    vector<uint32_t> abstractLengths(count);
+    bool cachedEmbeddings = context.scorer == SCORER_EMBEDDING && abstractEmbeddings && abstractEmbeddings->size() == count;
+    for (size_t i = 0; i < count; i++) {
+        string_view abstract = batch.abstract(i);
+        abstractLengths[i] = (uint32_t)abstract.size();
+        double similarityScore = cachedEmbeddings ? calculateEmbeddingScore(context, (*abstractEmbeddings)[i])
+                                                  : calculateSimilarityScore(context, abstract);
+        scores[i] = (calculateKeywordMatchScore(abstract, context) * KEYWORD_MATCH_WEIGHT) +
+                    (similarityScore * SIMILARITY_WEIGHT);
+    }
+    
+    const int* years = batch.years.data();
+    const int* citationCounts = batch.citationCounts.data();
+    const array<double, 1001>& citationTable = citationScoreTable();
+    for (size_t i = 0; i < count; i++) {
+        scores[i] = scores[i] +
+                    (calculateRecencyScore(years[i], currentYear) * RECENCY_WEIGHT) +
+                    (calculateCitationScore(citationCounts[i], citationTable) * CITATION_WEIGHT) +
+                    (calculateLengthScore(abstractLengths[i]) * LENGTH_WEIGHT);
+    }
+}
+
+// Function to checksum a byte range (32-bit FNV-1a)
+uint32_t checksumBytes(string_view data) {
+    uint32_t hash = 2166136261u;
+    for (char c : data) {
+        hash ^= (unsigned char)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Function to take (LOCK_EX) or release (LOCK_UN) the advisory lock other processes check before writing a file
+void lockFileDescriptor(int fd, int operation) {
+    while (flock(fd, operation) != 0 && errno == EINTR) {
+    }
+}
+
+// Holds the advisory lock of a file descriptor until the end of a scope
+class ScopedFileLock {
+public:
+    explicit ScopedFileLock(int fd) : fd(fd) {
+        lockFileDescriptor(fd, LOCK_EX);
+    }
+    
+    ~ScopedFileLock() {
+        lockFileDescriptor(fd, LOCK_UN);
+    }
+    
+    ScopedFileLock(const ScopedFileLock&) = delete;
+    ScopedFileLock& operator=(const ScopedFileLock&) = delete;
+    
+private:
+    int fd;
+};
+
+// Persistent on-disk cache of API responses with per-entry expiry
+// The file is a header followed by append-only records (RecordHeader + body). It is memory-mapped
+// on startup and scanned once to build the in-memory index; later records for the same key win.
+// When the file grows past maxBytes it is compacted, keeping the newest live entries.
+// Several processes can share the file: loading, appending and compacting happen under an exclusive
+// flock, appends go to the end of the file as it is then (records other processes added are indexed
+// first), and a process that finds the file replaced by another one's compaction reloads it.
+class ResponseCache {
+public:
+    ~ResponseCache() {
+        close();
+    }
+    
+    // Function to open (or create) the cache file in a directory, returns false if caching is unavailable
+    bool open(const string& directory, size_t maxBytes) {
+        lock_guard<mutex> lock(cacheMutex);
+        close();
+        this->maxBytes = maxBytes;
+        mkdir(directory.c_str(), 0755);
+        path = directory + "/responses.bin";
+        return load();
+    }
+    
+    bool isOpen() {
+        lock_guard<mutex> lock(cacheMutex);
+        return fd >= 0;
+    }
+    
+    // Function to look up an unexpired entry, returns false on a miss
+    bool lookup(uint64_t key, string& value) {
+        lock_guard<mutex> lock(cacheMutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        if (it->second.expiresAt <= (int64_t)time(0) || !readBody(key, it->second, value)) {
+            index.erase(it);
+            return false;
+        }
+        return true;
+    }
+    
+    // Function to add an entry that expires after ttlSeconds
+    void store(uint64_t key, string_view value, int64_t ttlSeconds) {
+        lock_guard<mutex> lock(cacheMutex);
+        if (fd < 0 || value.size() > maxBytes / 4) {
+            return;
+        }
+        
+        RecordHeader header;
+        header.key = key;
+        header.storedAt = time(0);
+        header.expiresAt = header.storedAt + ttlSeconds;
+        header.length = (uint32_t)value.size();
+        header.checksum = checksumBytes(value);
+        if (!lockFile()) {
+            return;
+        }
+        indexAppendedRecords();
+        if (appendRecord(fd, fileSize, header, value)) {
+            index[key] = Entry{fileSize + sizeof(RecordHeader), header.length, header.storedAt, header.expiresAt};
+            fileSize += sizeof(RecordHeader) + header.length;
+            if (fileSize > maxBytes) {
+                compact();
+            }
+        }
+        if (fd >= 0) {
+            lockFileDescriptor(fd, LOCK_UN);
+        }
+    }
+    
+private:
+    static constexpr uint32_t MAGIC = 0x43525048;  // "HPRC"
+    static constexpr uint32_t VERSION = 1;
+    
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+    };
+    
+    struct RecordHeader {
+        uint64_t key;
+        int64_t storedAt;
+        int64_t expiresAt;
+        uint32_t length;
+        uint32_t checksum;  // Detects records torn by a crash mid-write
+    };
+    
+    struct Entry {
+        uint64_t offset;  // Offset of the body in the file
+        uint32_t length;
+        int64_t storedAt;
+        int64_t expiresAt;
+    };
+    
+    mutex cacheMutex;
+    string path;
+    size_t maxBytes = 0;
+    int fd = -1;
+    const char* mapped = nullptr;  // Read-only mapping of the file as it was when loaded
+    size_t mappedSize = 0;
+    uint64_t fileSize = 0;
+    unordered_map<uint64_t, Entry> index;
+    
+    static bool appendRecord(int fd, uint64_t offset, const RecordHeader& header, string_view body) {
+        return pwrite(fd, &header, sizeof(header), offset) == (ssize_t)sizeof(header) &&
+               pwrite(fd, body.data(), body.size(), offset + sizeof(header)) == (ssize_t)body.size();
+    }
+    
+    void close() {
+        if (mapped) {
+            munmap((void*)mapped, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        index.clear();
+        fileSize = 0;
+    }
+    
+    // Function to take the inter-process lock on the cache file, returns false if the cache had to be closed
+    // If another process has replaced the file (by compacting) since it was opened, the new file is opened
+    // with an empty index; indexAppendedRecords then picks up its records.
+    bool lockFile() {
+        while (fd >= 0) {
+            lockFileDescriptor(fd, LOCK_EX);
+            struct stat opened, current;
+            if (fstat(fd, &opened) == 0 && stat(path.c_str(), &current) == 0 &&
+                opened.st_dev == current.st_dev && opened.st_ino == current.st_ino) {
+                return true;
+            }
+            close();  // Also drops the lock on the old file
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            fileSize = sizeof(FileHeader);
+        }
+        return false;
+    }
+    
+    // Function to open, map and index the file under the inter-process lock
+    bool load() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || !lockFile()) {
+            close();
+            return false;
+        }
+        bool loaded = loadLocked();
+        if (fd >= 0) {
+            lockFileDescriptor(fd, LOCK_UN);
+        }
+        return loaded;
+    }
+    
+    // Function to map the file and index its records, dropping anything after a torn record
+    bool loadLocked() {
+        struct stat info;
+        fstat(fd, &info);
+        fileSize = info.st_size;
+        if (fileSize < sizeof(FileHeader)) {
+            FileHeader header{MAGIC, VERSION};
+            if (ftruncate(fd, 0) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+                close();
+                return false;
+            }
+            fileSize = sizeof(header);
+            return true;
+        }
+        
+        void* map = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close();
+            return false;
+        }
+        mapped = (const char*)map;
+        mappedSize = fileSize;
+        
+        FileHeader fileHeader;
+        memcpy(&fileHeader, mapped, sizeof(fileHeader));
+        if (fileHeader.magic != MAGIC || fileHeader.version != VERSION) {
+            // Unknown format: start over (in place, as other processes may have the file open)
+            munmap(map, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+            FileHeader header{MAGIC, VERSION};
+            if (ftruncate(fd, 0) != 0 || pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+                close();
+                return false;
+            }
+            fileSize = sizeof(header);
+            return true;
+        }
+        
+        int64_t now = time(0);
+        uint64_t offset = sizeof(FileHeader);
+        while (offset + sizeof(RecordHeader) <= mappedSize) {
+            RecordHeader header;
+            memcpy(&header, mapped + offset, sizeof(header));
+            uint64_t bodyOffset = offset + sizeof(header);
+            if (bodyOffset + header.length > mappedSize ||
+                checksumBytes(string_view(mapped + bodyOffset, header.length)) != header.checksum) {
+                break;
+            }
+            if (header.expiresAt > now) {
+                index[header.key] = Entry{bodyOffset, header.length, header.storedAt, header.expiresAt};
+            } else {
+                index.erase(header.key);
+            }
+            offset = bodyOffset + header.length;
+        }
+        if (offset < fileSize && ftruncate(fd, offset) == 0) {
+            fileSize = offset;
+        }
+        
+        if (fileSize > maxBytes) {
+            compact();
+        }
+        return true;
+    }
+    
+    // Function to index the records other processes appended since this one last wrote (call under the lock)
+    // A torn record at the end can only come from a writer that crashed, so it is cut off
+    void indexAppendedRecords() {
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (uint64_t)info.st_size <= fileSize) {
+            return;
+        }
+        int64_t now = time(0);
+        uint64_t offset = fileSize;
+        string body;
+        while (offset + sizeof(RecordHeader) <= (uint64_t)info.st_size) {
+            RecordHeader header;
+            uint64_t bodyOffset = offset + sizeof(header);
+            if (!readAt(offset, &header, sizeof(header)) || bodyOffset + header.length > (uint64_t)info.st_size) {
+                break;
+            }
+            body.resize(header.length);
+            if (!readAt(bodyOffset, &body[0], header.length) || checksumBytes(body) != header.checksum) {
+                break;
+            }
+            if (header.expiresAt > now) {
+                index[header.key] = Entry{bodyOffset, header.length, header.storedAt, header.expiresAt};
+            } else {
+                index.erase(header.key);
+            }
+            offset = bodyOffset + header.length;
+        }
+        if (offset < (uint64_t)info.st_size && ftruncate(fd, offset) != 0) {
+            offset = info.st_size;  // Could not cut the torn record off, so at least do not write over it
+        }
+        fileSize = offset;
+    }
+    
+    // Function to read bytes from the mapping, or from the file if they were appended after loading
+    bool readAt(uint64_t offset, void* data, size_t length) {
+        if (mapped && offset + length <= mappedSize) {
+            memcpy(data, mapped + offset, length);
+            return true;
+        }
+        return pread(fd, data, length, offset) == (ssize_t)length;
+    }
+    
+    // Function to read an entry's body, returns false unless its record header still matches the key and checksum
+    bool readBody(uint64_t key, const Entry& entry, string& value) {
+        RecordHeader header;
+        if (entry.offset < sizeof(FileHeader) + sizeof(header) ||
+            !readAt(entry.offset - sizeof(header), &header, sizeof(header)) ||
+            header.key != key || header.length != entry.length) {
+            return false;
+        }
+        value.resize(entry.length);
+        return readAt(entry.offset, &value[0], entry.length) && checksumBytes(value) == header.checksum;
+    }
+    
+    // Function to rewrite the file with only the newest unexpired entries, down to half of maxBytes
+    void compact() {
+        int64_t now = time(0);
+        vector<pair<uint64_t, Entry>> live;
+        for (const auto& item : index) {
+            if (item.second.expiresAt > now) {
+                live.push_back(item);
+            }
+        }
+        sort(live.begin(), live.end(), [](const pair<uint64_t, Entry>& a, const pair<uint64_t, Entry>& b) {
+            return a.second.storedAt > b.second.storedAt;
+        });
+        
+        string tempPath = path + ".tmp";
+        int tempFd = ::open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (tempFd < 0) {
+            return;
+        }
+        FileHeader fileHeader{MAGIC, VERSION};
+        uint64_t offset = sizeof(fileHeader);
+        bool ok = pwrite(tempFd, &fileHeader, sizeof(fileHeader), 0) == (ssize_t)sizeof(fileHeader);
+        
+        unordered_map<uint64_t, Entry> newIndex;
+        string body;
+        for (const auto& item : live) {
+            if (!ok || offset + sizeof(RecordHeader) + item.second.length > maxBytes / 2) {
+                break;
+            }
+            if (!readBody(item.first, item.second, body)) {
+                continue;
+            }
+            RecordHeader header{item.first, item.second.storedAt, item.second.expiresAt, item.second.length, checksumBytes(body)};
+            ok = appendRecord(tempFd, offset, header, body);
+            newIndex[item.first] = Entry{offset + sizeof(header), header.length, header.storedAt, header.expiresAt};
+            offset += sizeof(header) + header.length;
+        }
+        
+        if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+            ::close(tempFd);
+            unlink(tempPath.c_str());
+            return;
+        }
+        
+        // Switch over to the compacted file
+        if (mapped) {
+            munmap((void*)mapped, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+        ::close(fd);
+        fd = tempFd;
+        fileSize = offset;
+        index.swap(newIndex);
+    }
+};
+
+// Time-to-live of cached responses per endpoint
+const int64_t GROQ_CACHE_TTL_SECONDS = 7 * 24 * 60 * 60;
+const int64_t SEMANTIC_SCHOLAR_CACHE_TTL_SECONDS = 24 * 60 * 60;
+const int64_t OPENALEX_CACHE_TTL_SECONDS = 24 * 60 * 60;
+
+// Function to get the process-wide response cache (disabled until opened)
+ResponseCache& sharedResponseCache() {
+    static ResponseCache cache;
+    return cache;
+}
+
+// Function to normalize text for use in a cache key: lowercase, trimmed, whitespace runs collapsed
+string normalizeForCacheKey(const string& text) {
+    string normalized;
+    normalized.reserve(text.size());
+    bool pendingSpace = false;
+    for (char c : text) {
+        if (isspace((unsigned char)c)) {
+            pendingSpace = !normalized.empty();
+        } else {
+            if (pendingSpace) {
+                normalized += ' ';
+                pendingSpace = false;
+            }
+            normalized += (char)tolower((unsigned char)c);
+        }
+    }
+    return normalized;
+}
+
+// Function to build the cache key of a request to an endpoint
+uint64_t makeCacheKey(const string& endpoint, const string& request) {
+    return hashTerm(endpoint + "\n" + normalizeForCacheKey(request));
+}
+
+// Appends every API request/response pair to a JSON-lines file so a stand-in server can replay them
+// Each line is {"endpoint": "groq"|"semanticscholar"|"openalex", "request": ..., "status": ..., "body": ...}, where
+// the request is the POST body for Groq and the query string for the searches (independent of the base URL)
+class RequestRecorder {
+public:
+    // Function to start recording to path (appending), returns false if it cannot be opened
+    bool open(const string& path) {
+        lock_guard<mutex> lock(fileMutex);
+        file.open(path, ios::app);
+        return (bool)file;
+    }
+    
+    bool isOpen() const {
+        return file.is_open();
+    }
+    
+    void record(const string& endpoint, const string& request, long status, const string& body) {
+        if (!file.is_open()) {
+            return;
+        }
+        string line = "{\"endpoint\":\"" + escapeJson(endpoint) + "\",\"request\":\"" + escapeJson(request) +
+                      "\",\"status\":" + to_string(status) + ",\"body\":\"" + escapeJson(body) + "\"}\n";
+        lock_guard<mutex> lock(fileMutex);
+        file << line << flush;
+    }
+    
+private:
+    mutex fileMutex;
+    ofstream file;
+};
+
+// Function to get the recorder shared by all API calls (inactive unless --record opened it)
+RequestRecorder& sharedRequestRecorder() {
+    static RequestRecorder recorder;
+    return recorder;
+}
+
+// Interface for receiving events from the streaming JSON parser
+// String views are only valid for the duration of the call
+struct JsonHandler {
+    virtual ~JsonHandler() {}
+    virtual void onStartObject() {}
+    virtual void onEndObject() {}
+    virtual void onStartArray() {}
+    virtual void onEndArray() {}
+    virtual void onKey(string_view) {}
+    virtual void onString(string_view) {}
+    virtual void onNumber(string_view) {}
+    virtual void onBool(bool) {}
+    virtual void onNull() {}
+};
+
+// Single-pass, SAX-style JSON parser
+// Input can be fed in arbitrary chunks; a token cut off at the end of a chunk is kept and resumed on the next feed
+// Strings without escapes are passed to the handler as views into the input; only escaped strings are copied
+class JsonStreamParser {
+public:
+    explicit JsonStreamParser(JsonHandler& handler) : handler(handler) {}
+    
+    // Parse the next chunk of input, returns false on a syntax error
+    bool feed(string_view chunk) {
+        if (failed) {
+            return false;
+        }
+        if (pending.empty()) {
+            size_t consumed = parse(chunk, false);
+            if (!failed) {
+                pending.assign(chunk.substr(consumed));
+            }
+        } else {
+            pending.append(chunk);
+            size_t consumed = parse(pending, false);
+            pending.erase(0, consumed);
+        }
+        return !failed;
+    }
+    
+    // Signal end of input, returns true if exactly one complete value was parsed
+    bool finish() {
+        if (!failed && !pending.empty()) {
+            string rest;
+            rest.swap(pending);
+            parse(rest, true);
+        }
+        return !failed && state == AFTER_VALUE && stack.empty();
+    }
+    
+    // Stop parsing, e.g. once the handler has everything it needs
+    void abort() {
+        failed = true;
+    }
+    
+private:
+    enum State { EXPECT_VALUE, ARRAY_FIRST, OBJECT_FIRST, OBJECT_KEY, EXPECT_COLON, AFTER_VALUE };
+    enum TokenResult { TOKEN_OK, TOKEN_INCOMPLETE, TOKEN_ERROR };
+    
+    JsonHandler& handler;
+    vector<char> stack;          // Open containers: '{' or '['
+    State state = EXPECT_VALUE;
+    string pending;              // Unconsumed tail of the previous chunk
+    string scratch;              // Decoded copy of the current string when it contains escapes
+    bool failed = false;
+    
+    // Function to parse as much of data as possible, returns how many bytes were consumed
+    size_t parse(string_view data, bool final) {
+        size_t pos = 0;
+        while (!failed) {
+            while (pos < data.size() && isspace((unsigned char)data[pos])) pos++;
+            if (pos >= data.size()) {
+                return pos;
+            }
+            
+            size_t tokenStart = pos;
+            char c = data[pos];
+            TokenResult result = TOKEN_OK;
+            
+            switch (state) {
+                case EXPECT_VALUE:
+                case ARRAY_FIRST:
+                    if (c == ']' && state == ARRAY_FIRST) {
+                        pos++;
+                        result = closeContainer('[');
+                    } else {
+                        result = parseValue(data, pos, final);
+                    }
+                    break;
+                case OBJECT_FIRST:
+                case OBJECT_KEY:
+                    if (c == '}' && state == OBJECT_FIRST) {
+                        pos++;
+                        result = closeContainer('{');
+                    } else if (c == '"') {
+                        string_view key;
+                        result = parseString(data, pos, final, key);
+                        if (result == TOKEN_OK) {
+                            handler.onKey(key);
+                            state = EXPECT_COLON;
+                        }
+                    } else {
+                        result = TOKEN_ERROR;
+                    }
+                    break;
+                case EXPECT_COLON:
+                    if (c == ':') {
+                        pos++;
+                        state = EXPECT_VALUE;
+                    } else {
+                        result = TOKEN_ERROR;
+                    }
+                    break;
+                case AFTER_VALUE:
+                    pos++;
+                    if (stack.empty()) {
+                        result = TOKEN_ERROR;  // Trailing garbage after the document
+                    } else if (c == ',') {
+                        state = stack.back() == '{' ? OBJECT_KEY : EXPECT_VALUE;
+                    } else if (c == '}' || c == ']') {
+                        result = closeContainer(c == '}' ? '{' : '[');
+                    } else {
+                        result = TOKEN_ERROR;
+                    }
+                    break;
+            }
+            
+            if (result == TOKEN_INCOMPLETE) {
+                return tokenStart;
+            }
+            if (result == TOKEN_ERROR) {
+                failed = true;
+            }
+        }
+        return pos;
+    }
+    
+    // Function to pop a container after checking it matches the closing bracket
+    TokenResult closeContainer(char open) {
+        if (stack.empty() || stack.back() != open) {
+            return TOKEN_ERROR;
+        }
+        stack.pop_back();
+        if (open == '{') {
+            handler.onEndObject();
+        } else {
+            handler.onEndArray();
+        }
+        state = AFTER_VALUE;
+        return TOKEN_OK;
+    }
+    
+    // Function to parse one value (or open a container) starting at pos
+    TokenResult parseValue(string_view data, size_t& pos, bool final) {
+        char c = data[pos];
+        if (c == '{' || c == '[') {
+            pos++;
+            stack.push_back(c);
+            if (c == '{') {
+                handler.onStartObject();
+                state = OBJECT_FIRST;
+            } else {
+                handler.onStartArray();
+                state = ARRAY_FIRST;
+            }
+            return TOKEN_OK;
+        }
+        
+        if (c == '"') {
+            string_view value;
+            TokenResult result = parseString(data, pos, final, value);
+            if (result == TOKEN_OK) {
+                handler.onString(value);
+                state = AFTER_VALUE;
+            }
+            return result;
+        }
+        
+        if (c == 't' || c == 'f' || c == 'n') {
+            string_view literal = c == 't' ? "true" : (c == 'f' ? "false" : "null");
+            string_view available = data.substr(pos, literal.size());
+            if (available != literal.substr(0, available.size())) {
+                return TOKEN_ERROR;
+            }
+            if (available.size() < literal.size()) {
+                return final ? TOKEN_ERROR : TOKEN_INCOMPLETE;
+            }
+            pos += literal.size();
+            if (c == 'n') {
+                handler.onNull();
+            } else {
+                handler.onBool(c == 't');
+            }
+            state = AFTER_VALUE;
+            return TOKEN_OK;
+        }
+        
+        if (c == '-' || isdigit((unsigned char)c)) {
+            size_t end = pos;
+            while (end < data.size() && (isdigit((unsigned char)data[end]) || data[end] == '-' || data[end] == '+' ||
+                                         data[end] == '.' || data[end] == 'e' || data[end] == 'E')) {
+                end++;
+            }
+            // A number running into the end of the chunk may continue in the next one
+            if (end == data.size() && !final) {
+                return TOKEN_INCOMPLETE;
+            }
+            handler.onNumber(data.substr(pos, end - pos));
+            pos = end;
+            state = AFTER_VALUE;
+            return TOKEN_OK;
+        }
+        
+        return TOKEN_ERROR;
+    }
+    
+    // Function to parse a quoted string, decoding escapes into scratch only when present
+    TokenResult parseString(string_view data, size_t& pos, bool final, string_view& out) {
+        size_t start = pos + 1;
+        size_t end = start;
+        bool escaped = false;
+        while (end < data.size() && data[end] != '"') {
+            if (data[end] == '\\') {
+                escaped = true;
+                end++;
+            }
+            end++;
+        }
+        if (end >= data.size()) {
+            return final ? TOKEN_ERROR : TOKEN_INCOMPLETE;
+        }
+        
+        if (!escaped) {
+            out = data.substr(start, end - start);
+        } else {
+            if (!unescapeJsonString(data.substr(start, end - start), scratch)) {
+                return TOKEN_ERROR;
+            }
+            out = scratch;
+        }
+        pos = end + 1;
+        return TOKEN_OK;
+    }
+    
+    // Function to parse 4 hex digits of a \u escape
+    static bool parseHex4(string_view text, size_t pos, unsigned& value) {
+        if (pos + 4 > text.size()) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = pos; i < pos + 4; i++) {
+            char c = text[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+    
+    // Function to append a Unicode code point as UTF-8
+    static void appendUtf8(string& out, unsigned codePoint) {
+        if (codePoint < 0x80) {
+            out += (char)codePoint;
+        } else if (codePoint < 0x800) {
+            out += (char)(0xC0 | (codePoint >> 6));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            out += (char)(0xE0 | (codePoint >> 12));
+            out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        } else {
+            out += (char)(0xF0 | (codePoint >> 18));
+            out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+            out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            out += (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+    
+    // Function to decode the escape sequences of a JSON string body
+    static bool unescapeJsonString(string_view text, string& out) {
+        out.clear();
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] != '\\') {
+                out += text[i];
+                continue;
+            }
+            if (++i >= text.size()) {
+                return false;
+            }
+            switch (text[i]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned codePoint;
+                    if (!parseHex4(text, i + 1, codePoint)) {
+                        return false;
+                    }
+                    i += 4;
+                    // Combine a UTF-16 surrogate pair; a lone surrogate becomes U+FFFD
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                        unsigned low;
+                        if (i + 2 < text.size() && text[i + 1] == '\\' && text[i + 2] == 'u' &&
+                            parseHex4(text, i + 3, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        } else {
+                            codePoint = 0xFFFD;
+                        }
+                    } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                        codePoint = 0xFFFD;
+                    }
+                    appendUtf8(out, codePoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Function to extract text from JSON response (Groq format)
+string extractTextFromResponse(const string& response) {
+    // Groq uses OpenAI format: {"choices":[{"message":{"content":"text here"}}]}
+    size_t contentPos = response.find("\"content\"");
+    if (contentPos == string::npos) {
+        return "Error: Could not parse response";
+    }
+    
+    // Find the content after "content": "
+    size_t startQuote = response.find("\"", contentPos + 9);
+    size_t endQuote = startQuote + 1;
+    
+    // Handle escaped quotes in the content
+    while (endQuote < response.length()) {
+        endQuote = response.find("\"", endQuote);
+        if (endQuote == string::npos) {
+            return "Error: Could not extract text from response";
+        }
+        // Check if this quote is escaped
+        if (response[endQuote - 1] != '\\') {
+            break;
+        }
+        endQuote++;
+    }
+    
+    if (startQuote == string::npos || endQuote == string::npos) {
+        return "Error: Could not extract text from response";
+    }
+    
+    string extractedText = response.substr(startQuote + 1, endQuote - startQuote - 1);
+    
+    // Clean up escape sequences (each pass starts over from the beginning, so a JSON answer gets its quotes back)
+    size_t pos = 0;
+    while ((pos = extractedText.find("\\n", pos)) != string::npos) {
+        extractedText.replace(pos, 2, " ");
+    }
+    pos = 0;
+    while ((pos = extractedText.find("\\r", pos)) != string::npos) {
+        extractedText.replace(pos, 2, " ");
+    }
+    pos = 0;
+    while ((pos = extractedText.find("\\\"", pos)) != string::npos) {
+        extractedText.replace(pos, 2, "\"");
+        pos++;
+    }
+    
+    // Trim whitespace
+    extractedText.erase(0, extractedText.find_first_not_of(" \t\n\r"));
+    extractedText.erase(extractedText.find_last_not_of(" \t\n\r") + 1);
+    
+    return extractedText;
+}
+
+// JSON handler that appends the "content" strings of a streamed chat completion chunk
+// ({"choices":[{"delta":{"content":"..."}}]}) to the answer
+class ChatDeltaHandler : public JsonHandler {
+public:
+    explicit ChatDeltaHandler(string& answer) : answer(answer) {}
+    
+    void onKey(string_view key) override { contentKey = key == "content"; }
+    void onString(string_view value) override {
+        if (contentKey) {
+            answer.append(value);
+        }
+    }
+    
+private:
+    string& answer;
+    bool contentKey = false;
+};
+
+// Incremental decoder of a streamed chat completion (server-sent events, one "data: {json}" line per chunk)
+// Feed it the body in chunks as they arrive. A server that ignores "stream" and sends one plain JSON body
+// is handled too: the body is collected and decoded at the end like a normal response.
+class ChatStreamDecoder {
+public:
+    void feed(string_view chunk) {
+        if (!plain && pending.empty() && answer.empty() && !finished) {
+            size_t first = chunk.find_first_not_of(" \t\r\n");
+            if (first == string_view::npos) {
+                return;
+            }
+            plain = chunk[first] == '{';
+        }
+        if (plain) {
+            plainBody.append(chunk);
+            return;
+        }
+        
+        pending.append(chunk);
+        size_t lineStart = 0;
+        size_t lineEnd;
+        while ((lineEnd = pending.find('\n', lineStart)) != string::npos) {
+            string_view line(pending.data() + lineStart, lineEnd - lineStart);
+            lineStart = lineEnd + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (line.compare(0, 5, "data:") != 0) {
+                continue;  // Blank separators, comments and other SSE fields
+            }
+            string_view data = line.substr(line.size() > 5 && line[5] == ' ' ? 6 : 5);
+            if (data == "[DONE]") {
+                finished = true;
+                break;
+            }
+            ChatDeltaHandler handler(answer);
+            JsonStreamParser parser(handler);
+            parser.feed(data);
+            parser.finish();
+        }
+        pending.erase(0, lineStart);
+    }
+    
+    // Whether the server has signalled the end of the stream
+    bool done() const {
+        return finished;
+    }
+    
+    // Answer text received so far (of a plain response: nothing until text() is called at the end)
+    const string& partial() const {
+        return answer;
+    }
+    
+    // Function to get the answer, cleaned up like extractTextFromResponse does
+    string text() const {
+        if (plain) {
+            return extractTextFromResponse(plainBody);
+        }
+        if (answer.empty()) {
+            return "Error: Could not parse response";
+        }
+        string cleaned = answer;
+        replace(cleaned.begin(), cleaned.end(), '\n', ' ');
+        replace(cleaned.begin(), cleaned.end(), '\r', ' ');
+        cleaned.erase(0, cleaned.find_first_not_of(" \t"));
+        cleaned.erase(cleaned.find_last_not_of(" \t") + 1);
+        return cleaned;
+    }
+    
+private:
+    string pending;    // Start of a line that has not fully arrived
+    string answer;
+    string plainBody;
+    bool plain = false;
+    bool finished = false;
+};
+
+// Per-call limits of a Groq request
+struct GroqCallLimits {
+    int maxTokens = 500;  // Completion budget, sent as max_tokens and charged to the token rate limiter
+    function<bool(const string&)> isAnswered;  // Given the streamed text so far; true stops reading (empty = read all)
+};
+
+// Function to tell if text contains one of the labels as a whole word that has fully arrived
+// A label only counts once the character after it has been received too, so "Scientific" is never taken
+// from the start of "Scientifically" and "VALID" never from "VALIDATION". Markdown, quotes or a short
+// preamble around the label do not matter; the callers search the whole answer for it.
+bool containsCompleteLabel(const string& text, initializer_list<const char*> labels) {
+    auto isWordChar = [](unsigned char c) { return isalnum(c) || c == '_'; };
+    for (const char* label : labels) {
+        size_t length = strlen(label);
+        for (size_t pos = text.find(label); pos != string::npos; pos = text.find(label, pos + 1)) {
+            if ((pos == 0 || !isWordChar(text[pos - 1])) && pos + length < text.size() && !isWordChar(text[pos + length])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Function to tell if a streamed classification already names its label
+bool classificationAnswered(const string& text) {
+    return containsCompleteLabel(text, {"Not_Scientific", "Scientific"});
+}
+
+// Function to tell if a streamed validation already names its label ("VALID" alone never matches inside "INVALID")
+bool validationAnswered(const string& text) {
+    return containsCompleteLabel(text, {"INVALID", "VALID"});
+}
+
+// Function to find the end of the first complete JSON object in text (braces inside strings are ignored)
+// Returns the position just past its closing brace, or string_view::npos if no object has been closed yet
+size_t jsonObjectEnd(string_view text) {
+    int depth = 0;
+    bool inString = false;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (inString) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c == '"') {
+            inString = depth > 0;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && depth > 0 && --depth == 0) {
+            return i + 1;
+        }
+    }
+    return string_view::npos;
+}
+
+// Function to tell if a streamed answer already contains a complete JSON object
+bool jsonObjectComplete(const string& text) {
+    return jsonObjectEnd(text) != string_view::npos;
+}
+
+// Function to call Groq API
+// The answer is streamed and decoded as it arrives, so a call whose limits say it is answered stops
+// reading right away instead of waiting for the whole completion
+string callGroqAPI(const string& prompt, const GroqCallLimits& limits = GroqCallLimits()) {
+    // Create JSON request body in OpenAI format
+    // Using llama-3.1-70b-versatile model (fast and capable)
+    string jsonData = "{"
+                     "\"model\":\"" + GROQ_MODEL + "\","
+                     "\"messages\":[{\"role\":\"user\",\"content\":\"" + escapeJson(prompt) + "\"}],"
+                     "\"temperature\":0.3,"
+                     "\"max_tokens\":" + to_string(limits.maxTokens) +
+                     (groqStreaming ? ",\"stream\":true" : "") +
+                     "}";
+    
+    // Set headers with API key
+    vector<string> headers = {
+        "Content-Type: application/json",
+        "Authorization: Bearer " + GROQ_API_KEY
+    };
+    
+    // Cache hits skip the network and the rate limiter entirely
+    // The key covers the completion budget, since a smaller one can truncate the answer. An answer that was
+    // cut short once the caller had what it needed is kept under its own key, and it is only served to calls
+    // that stop early too (each prompt comes from one caller, so it is always the same isAnswered). A call
+    // that reads whole answers never gets a partial one.
+    string cacheEndpoint = "groq " + GROQ_MODEL + " max_tokens=" + to_string(limits.maxTokens);
+    uint64_t cacheKey = makeCacheKey(cacheEndpoint, prompt);
+    uint64_t cutShortKey = makeCacheKey(cacheEndpoint + " cut short", prompt);
+    string cachedBody;
+    if (sharedResponseCache().lookup(cacheKey, cachedBody) ||
+        (groqStreaming && limits.isAnswered && sharedResponseCache().lookup(cutShortKey, cachedBody))) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.endpoints[groqPolicy().name].cacheHits++; });
+        sharedRequestRecorder().record("groq", jsonData, 200, cachedBody);
+        return extractTextFromResponse(cachedBody);
+    }
+    
+    // The limiter is charged for the prompt and the whole completion budget, like Groq's own token limit
+    ChatStreamDecoder decoder;
+    HttpResponse response = performWithRetry(groqPolicy(), estimatePromptTokens(prompt) + limits.maxTokens, [&]() {
+        if (!groqStreaming) {
+            return sharedHttpClient().post(groqApiUrl, jsonData, headers);
+        }
+        decoder = ChatStreamDecoder();
+        return sharedHttpClient().postStreaming(groqApiUrl, jsonData, [&](string_view chunk) {
+            decoder.feed(chunk);
+            // Past [DONE] only the end of the body is left, and reading it keeps the connection reusable
+            return decoder.done() || !limits.isAnswered || !limits.isAnswered(decoder.partial());
+        }, headers);
+    });
+    
+    if (response.curlCode == CURLE_FAILED_INIT) {
+        return "Error: Failed to initialize curl";
+    }
+    if (response.curlCode != CURLE_OK) {
+        cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.curlCode) << endl;
+        return "Error: API call failed";
+    }
+    if (response.status == 429) {
+        cerr << "Groq API rate limit still exceeded after retrying" << endl;
+        return "Error: API call failed";
+    }
+    
+    // A streamed answer is stored (and recorded) as the equivalent plain response
+    string text;
+    if (groqStreaming && response.status == 200) {
+        text = decoder.text();
+        if (text.rfind("Error:", 0) != 0) {
+            response.body = "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"" + escapeJson(text) + "\"}}]}";
+        }
+    } else {
+        text = extractTextFromResponse(response.body);
+    }
+    
+    sharedRequestRecorder().record("groq", jsonData, response.status, response.body);
+    if (response.status == 200 && text.rfind("Error:", 0) != 0) {
+        sharedResponseCache().store(response.stoppedEarly ? cutShortKey : cacheKey, response.body, GROQ_CACHE_TTL_SECONDS);
+    }
+    
+    return text;
+}
+
+// Function to check if question is scientific using Groq
+// If decided is given, it is set to whether the LLM actually gave an answer (false on API errors)
+bool isScientificQuestion(const string& question, bool* decided = nullptr) {
+    string prompt = "You are an expert query classifier whose job is to differentiate\n"
+                   "scientific queries/questions from general run-of-the-mill questions.\n\n"
+                   "A \"Scientific\" query inquires about natural phenomena, technology, engineering, medicine, mathematics, or formal science. It often seeks to understand how or why something works.\n"
+                   "It is the type of enquiry that requires support to strengthen its position, such as research and studies.\n\n"
+                   "A \"Not_Scientific\" query asks for simple facts, directions, recipes, opinions, news, sports scores, or personal advice. These types of enquiries often are\n"
+                   "quick and easy, not needed to be supported by any research or studies.\n\n"
+                   "-- EXAMPLES --\n"
+                   "Query: how do electromagnetic circuits work?\n"
+                   "Classification: Scientific\n\n"
+                   "Query: use of artificial intelligence in EVs\n"
+                   "Classification: Scientific\n\n"
+                   "Query: what is the weather today?\n"
+                   "Classification: Not_Scientific\n\n"
+                   "Query: how to cook an egg\n"
+                   "Classification: Not_Scientific\n\n"
+                   "Query: what were the football scores last night?\n"
+                   "Classification: Not_Scientific\n"
+                   "-- END EXAMPLES --\n\n"
+                   "Now, classify the following query. Respond with ONLY one word: Scientific or Not_Scientific.\n\n"
+                   "Query: " + question + "\n"
+                   "Classification:";
+    
+    // The answer is one label ("Not_Scientific" is the longest at a few tokens); the budget leaves room for
+    // a short preamble or markdown around it, and reading stops once the label has arrived
+    string response = callGroqAPI(prompt, {24, classificationAnswered});
+    
+    if (decided) {
+        *decided = response.find("Scientific") != string::npos;
+    }
+    if (response.find("Scientific") != string::npos) {
+        if (response.find("Not_Scientific") != string::npos) {
+            return false;
+        }
+        return true;
+    }
+    
+    return false;
+}
+
+// Local stand-in for the LLM classification: logistic regression over hashed word unigrams and bigrams
+// The weights live in a small binary file (ClassifierHeader, then CLASSIFIER_DIMENSIONS floats) trained
+// with --train-classifier from logged LLM decisions. Scoring a question takes microseconds.
+const size_t CLASSIFIER_DIMENSIONS = 4096;
+const uint32_t CLASSIFIER_MAGIC = 0x43515048;  // "HPQC"
+
+class QuestionClassifier {
+public:
+    // Function to load weights from a file, returns false if it is missing or corrupt
+    bool load(const string& path) {
+        ifstream file(path, ios::binary);
+        string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        ClassifierHeader header;
+        if (contents.size() != sizeof(header) + CLASSIFIER_DIMENSIONS * sizeof(float)) {
+            return false;
+        }
+        memcpy(&header, contents.data(), sizeof(header));
+        string_view data = string_view(contents).substr(sizeof(header));
+        if (header.magic != CLASSIFIER_MAGIC || header.dimensions != CLASSIFIER_DIMENSIONS ||
+            checksumBytes(data) != header.checksum) {
+            return false;
+        }
+        bias = header.bias;
+        memcpy(weights.data(), data.data(), data.size());
+        loaded = true;
+        return true;
+    }
+    
+    // Function to write the weights to a file (atomically), returns false on failure
+    bool save(const string& path) const {
+        string data((const char*)weights.data(), weights.size() * sizeof(float));
+        ClassifierHeader header;
+        header.magic = CLASSIFIER_MAGIC;
+        header.dimensions = CLASSIFIER_DIMENSIONS;
+        header.bias = bias;
+        header.checksum = checksumBytes(data);
+        
+        string tempPath = path + ".tmp";
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file << data;
+        file.close();
+        if (!file || rename(tempPath.c_str(), path.c_str()) != 0) {
+            unlink(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+    
+    bool isLoaded() const {
+        return loaded;
+    }
+    
+    // Function to estimate the probability (0-1) that a question is scientific
+    double probability(const string& question) const {
+        vector<uint32_t> active;
+        features(question, active);
+        return sigmoid(score(active));
+    }
+    
+    // Function to fit the weights to labelled questions (true = scientific) by stochastic gradient descent
+    void train(const vector<pair<string, bool>>& examples, int epochs) {
+        fill(weights.begin(), weights.end(), 0.0f);
+        bias = 0.0f;
+        vector<vector<uint32_t>> exampleFeatures(examples.size());
+        for (size_t i = 0; i < examples.size(); i++) {
+            features(examples[i].first, exampleFeatures[i]);
+        }
+        
+        const double L2 = 1e-4;
+        vector<size_t> order(examples.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        mt19937_64 random(0x5eed);  // Fixed, so retraining on the same log gives the same weights
+        for (int epoch = 0; epoch < epochs; epoch++) {
+            shuffle(order.begin(), order.end(), random);
+            double learningRate = 0.5 / (1.0 + epoch * 0.2);
+            for (size_t i : order) {
+                const vector<uint32_t>& active = exampleFeatures[i];
+                double error = sigmoid(score(active)) - (examples[i].second ? 1.0 : 0.0);
+                for (uint32_t feature : active) {
+                    weights[feature] -= (float)(learningRate * (error + L2 * weights[feature]));
+                }
+                bias -= (float)(learningRate * error);
+            }
+        }
+        loaded = true;
+    }
+    
+private:
+    struct ClassifierHeader {
+        uint32_t magic;
+        uint32_t dimensions;
+        float bias;
+        uint32_t checksum;        // Of the weights
+    };
+    
+    vector<float> weights = vector<float>(CLASSIFIER_DIMENSIONS, 0.0f);
+    float bias = 0.0f;
+    bool loaded = false;
+    
+    // Function to list the distinct feature indices of a question: its words and adjacent word pairs
+    static void features(const string& question, vector<uint32_t>& active) {
+        thread_local vector<uint64_t> hashes;
+        tokenHashes(question, hashes);
+        active.clear();
+        for (size_t i = 0; i < hashes.size(); i++) {
+            active.push_back(featureIndex(hashes[i]));
+            if (i > 0) {
+                active.push_back(featureIndex(hashes[i - 1] * 0x9e3779b97f4a7c15ULL ^ hashes[i]));
+            }
+        }
+        sort(active.begin(), active.end());
+        active.erase(unique(active.begin(), active.end()), active.end());
+    }
+    
+    static uint32_t featureIndex(uint64_t hash) {
+        hash ^= hash >> 31;
+        return (uint32_t)(hash & (CLASSIFIER_DIMENSIONS - 1));
+    }
+    
+    double score(const vector<uint32_t>& active) const {
+        double sum = bias;
+        for (uint32_t feature : active) {
+            sum += weights[feature];
+        }
+        return sum;
+    }
+    
+    static double sigmoid(double x) {
+        return 1.0 / (1.0 + exp(-x));
+    }
+};
+
+// Function to get the classifier shared by all queries (unloaded unless --classifier loaded it)
+QuestionClassifier& sharedQuestionClassifier() {
+    static QuestionClassifier classifier;
+    return classifier;
+}
+
+// Appends every LLM classification to a file as training data for the local classifier
+// Each line is "Scientific" or "Not_Scientific", a tab, and the question on one line
+class ClassificationLog {
+public:
+    // Function to start logging to path (appending), returns false if it cannot be opened
+    bool open(const string& path) {
+        lock_guard<mutex> lock(fileMutex);
+        file.open(path, ios::app);
+        return (bool)file;
+    }
+    
+    void record(const string& question, bool isScientific) {
+        if (!file.is_open()) {
+            return;
+        }
+        string line = question;
+        replace_if(line.begin(), line.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+        line = (isScientific ? "Scientific\t" : "Not_Scientific\t") + line + "\n";
+        lock_guard<mutex> lock(fileMutex);
+        file << line << flush;
+    }
+    
+private:
+    mutex fileMutex;
+    ofstream file;
+};
+
+// Function to get the log shared by all queries (inactive unless --classifier-log opened it)
+ClassificationLog& sharedClassificationLog() {
+    static ClassificationLog log;
+    return log;
+}
+
+// Function to read labelled questions written by ClassificationLog, returns false if the file cannot be read
+bool loadClassificationLog(const string& path, vector<pair<string, bool>>& examples) {
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    string line;
+    while (getline(file, line)) {
+        size_t tab = line.find('\t');
+        if (tab == string::npos || tab + 1 == line.size()) {
+            continue;
+        }
+        string label = line.substr(0, tab);
+        if (label == "Scientific" || label == "Not_Scientific") {
+            examples.push_back({line.substr(tab + 1), label == "Scientific"});
+        }
+    }
+    return true;
+}
+
+// Function to validate keywords and query using Groq
+string validateQueryWithGroq(const string& question, const string& keywords) {
+    string prompt = "You are an expert in scientific research and query validation.\n"
+                   "Your task is to determine if a research question and its keywords are valid.\n\n"
+                   "A query is INVALID if:\n"
+                   "1. The keywords are completely nonsensical or unrelated to each other\n"
+                   "2. The keywords don't match the query at all\n"
+                   "3. The query is just a list of keywords/topics rather than an actual question or research statement\n"
+                   "4. The concepts are contradictory or impossible (e.g., 'flat earth physics in spherical geometry')\n\n"
+                   "A query is VALID if:\n"
+                   "1. It's a proper question, statement, or research topic (not just keywords)\n"
+                   "2. The keywords are coherent and scientifically related\n"
+                   "3. The keywords match the intent of the query\n\n"
+                   "Respond with ONLY one word: VALID or INVALID\n\n"
+                   "-- EXAMPLES --\n"
+                   "Query: What is the impact of artificial intelligence on healthcare diagnostics?\n"
+                   "Keywords: artificial intelligence, healthcare diagnostics\n"
+                   "Response: VALID\n\n"
+                   "Query: How does quantum entanglement work in quantum computing?\n"
+                   "Keywords: quantum entanglement, quantum computing\n"
+                   "Response: VALID\n\n"
+                   "Query: artificial intelligence, healthcare, technology\n"
+                   "Keywords: artificial intelligence, healthcare, technology\n"
+                   "Response: INVALID\n\n"
+                   "Query: Purple elephants dancing with nuclear submarines\n"
+                   "Keywords: purple elephants, nuclear submarines\n"
+                   "Response: INVALID\n\n"
+                   "Query: Impact of Shakespeare on quantum mechanics\n"
+                   "Keywords: Shakespeare, quantum mechanics\n"
+                   "Response: INVALID\n"
+                   "-- END EXAMPLES --\n\n"
+                   "Now, validate the following.\n\n"
+                   "Query: " + question + "\n"
+                   "Keywords: " + keywords + "\n"
+                   "Response:";
+    
+    // One label: VALID or INVALID (with room for a short preamble or markdown around it)
+    return callGroqAPI(prompt, {24, validationAnswered});
+}
+
+// Function to expand keywords (keep full phrases + split into individual words)
+string expandKeywords(const string& keywords) {
+    vector<string> expandedKeywords;
+    istringstream ss(keywords);
+    string keyword;
+    
+    // Split by commas to get individual keywords/phrases
+    while (getline(ss, keyword, ',')) {
+        // Trim whitespace
+        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
+        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
+        
+        if (!keyword.empty()) {
+            // Add the full keyword/phrase first
+            expandedKeywords.push_back(keyword);
+        }
+    }
+    
+    // Now split each phrase into individual words
+    ss.clear();
+    ss.str(keywords);
+    while (getline(ss, keyword, ',')) {
+        // Trim whitespace
+        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
+        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
+        
+        if (!keyword.empty()) {
+            // Split multi-word phrases into individual words
+            istringstream wordStream(keyword);
+            string word;
+            while (wordStream >> word) {
+                // Remove punctuation from word
+                word.erase(remove_if(word.begin(), word.end(), 
+                    [](char c) { return !isalnum(c) && c != '-'; }), word.end());
+                
+                // Only add if it's not already in the list and not too short
+                if (word.length() > 2 && 
+                    find(expandedKeywords.begin(), expandedKeywords.end(), word) == expandedKeywords.end()) {
+                    expandedKeywords.push_back(word);
+                }
+            }
+        }
+    }
+    
+    // Join back into comma-separated string
+    string result;
+    for (size_t i = 0; i < expandedKeywords.size(); i++) {
+        result += expandedKeywords[i];
+        if (i < expandedKeywords.size() - 1) {
+            result += ", ";
+        }
+    }
+    
+    return result;
+}
+
+// Function to extract keywords using Groq
+string extractKeywordsWithGroq(const string& question) {
+    string prompt = "You are an expert in scientific research and natural language processing.\n"
+                   "Your task is to extract the most important scientific and technical keywords or keyphrases\n"
+                   "from a user's research question.\n\n"
+                   "Focus on nouns, noun phrases, and technical terms that represent the core subjects of the query.\n"
+                   "Ignore common stop words (e.g., 'the', 'is', 'a'), interrogative words (e.g., 'what', 'how'),\n"
+                   "and vague verbs (e.g., 'affect', 'impact').\n\n"
+                   "Return the keywords as a single, comma-separated string. Do not add any other explanation.\n\n"
+                   "-- EXAMPLES --\n"
+                   "Query: What is the effect of caffeine on human sleep cycles?\n"
+                   "Keywords: caffeine, human sleep cycles\n\n"
+                   "Query: The use of CRISPR-Cas9 for gene editing in treating genetic disorders.\n"
+                   "Keywords: CRISPR-Cas9, gene editing, genetic disorders\n\n"
+                   "Query: How do photovoltaic cells convert sunlight into electricity?\n"
+                   "Keywords: photovoltaic cells, sunlight, electricity\n"
+                   "-- END EXAMPLES --\n\n"
+                   "Now, extract the keywords from the following query.\n\n"
+                   "Query: " + question + "\n"
+                   "Keywords:";
+    
+    // A single line of keywords; the budget only guards against a rambling answer
+    return callGroqAPI(prompt, {100, nullptr});
+}
+
+// Function to parse a JSON number as an int without throwing (malformed values give the fallback)
+int parseJsonInt(string_view value, int fallback) {
+    double number;
+    from_chars_result parsed = from_chars(value.data(), value.data() + value.size(), number);
+    if (parsed.ec != errc() || parsed.ptr != value.data() + value.size()) {
+        return fallback;
+    }
+    // Accept forms like 12.0 or 1e3, and clamp anything out of range
+    number = max((double)INT_MIN, min((double)INT_MAX, number));
+    return (int)number;
+}
+
+// JSON handler that turns the "data" array of a Semantic Scholar search response into rows of a batch
+// Text is unescaped straight into the batch arena; each row is committed and reported as soon as its
+// closing brace is seen. Field order does not matter.
+class SemanticScholarHandler : public JsonHandler {
+public:
+    SemanticScholarHandler(ArticleBatch& batch, function<void(size_t)> onRow) : batch(batch), onRow(move(onRow)) {}
+    
+    void onStartObject() override {
+        depth++;
+        if (inData && depth == 3) {
+            batch.beginRow();
+            year = 0;
+            citationCount = 0;
+        }
+    }
+    
+    void onEndObject() override {
+        if (inData && depth == 3) {
+            batch.commitRow(year, citationCount);
+            onRow(batch.size() - 1);
+        }
+        depth--;
+    }
+    
+    void onStartArray() override {
+        depth++;
+        if (depth == 2 && rootKey == "data") {
+            inData = true;
+        }
+    }
+    
+    void onEndArray() override {
+        if (depth == 2) {
+            inData = false;
+        }
+        depth--;
+    }
+    
+    void onKey(string_view key) override {
+        if (depth == 1) {
+            rootKey.assign(key);
+        } else if (inData && depth == 3) {
+            field.assign(key);
+        }
+    }
+    
+    void onString(string_view value) override {
+        if (!inData || depth != 3) return;
+        if (field == "paperId") batch.setText(ArticleBatch::PAPER_ID, value);
+        else if (field == "title") batch.setText(ArticleBatch::TITLE, value);
+        else if (field == "abstract") batch.setText(ArticleBatch::ABSTRACT, value);
+        else if (field == "url") batch.setText(ArticleBatch::URL, value);
+    }
+    
+    void onNumber(string_view value) override {
+        if (!inData || depth != 3) return;
+        if (field == "year") year = parseJsonInt(value, 0);
+        else if (field == "citationCount") citationCount = parseJsonInt(value, 0);
+    }
+    
+private:
+    ArticleBatch& batch;
+    function<void(size_t)> onRow;
+    int year = 0;
+    int citationCount = 0;
+    string rootKey;
+    string field;
+    int depth = 0;
+    bool inData = false;
+};
+
+// JSON handler that collects the scalar fields of the top-level object as text
+// (strings unescaped, numbers as written, booleans as "true"/"false"); nested values are skipped
+class JsonFieldCollector : public JsonHandler {
+public:
+    unordered_map<string, string> fields;
+    
+    void onStartObject() override { depth++; }
+    void onEndObject() override { depth--; }
+    void onStartArray() override { depth++; }
+    void onEndArray() override { depth--; }
+    
+    void onKey(string_view key) override {
+        if (depth == 1) {
+            currentKey.assign(key);
+        }
+    }
+    
+    void onString(string_view value) override { store(value); }
+    void onNumber(string_view value) override { store(value); }
+    void onBool(bool value) override { store(value ? "true" : "false"); }
+    
+private:
+    string currentKey;
+    int depth = 0;
+    
+    void store(string_view value) {
+        if (depth == 1) {
+            fields[currentKey].assign(value);
+        }
+    }
+};
+
+// Function to parse a JSON object into its top-level scalar fields, returns false if it is not valid JSON
+bool parseJsonFields(string_view json, unordered_map<string, string>& fields) {
+    JsonFieldCollector collector;
+    JsonStreamParser parser(collector);
+    parser.feed(json);
+    if (!parser.finish()) {
+        return false;
+    }
+    fields = move(collector.fields);
+    return true;
+}
+
+// Classification, keywords and validation of a question, as returned by one structured LLM call
+struct QueryAnalysis {
+    bool isScientific = false;
+    string keywords;       // Comma-separated, empty when the question is not scientific
+    bool isValid = false;
+};
+
+// Function to parse the JSON object of a combined analysis response, returns false if it is malformed
+// Text around the first object (code fences, a leading "JSON:", trailing remarks) is ignored, and labels are matched case-insensitively
+bool parseQueryAnalysis(const string& response, QueryAnalysis& analysis) {
+    size_t open = response.find('{');
+    size_t end = jsonObjectEnd(response);
+    unordered_map<string, string> fields;
+    if (open == string::npos || end == string_view::npos ||
+        !parseJsonFields(string_view(response).substr(open, end - open), fields)) {
+        return false;
+    }
+    
+    auto normalized = [&](const string& name) {
+        string value = fields[name];
+        value.erase(0, value.find_first_not_of(" \t\n\r"));
+        value.erase(value.find_last_not_of(" \t\n\r") + 1);
+        transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return tolower(c); });
+        replace(value.begin(), value.end(), ' ', '_');
+        return value;
+    };
+    
+    string classification = normalized("classification");
+    if (classification != "scientific" && classification != "not_scientific") {
+        return false;
+    }
+    string validity = normalized("valid");
+    if (validity != "true" && validity != "false" && validity != "valid" && validity != "invalid") {
+        return false;
+    }
+    
+    analysis.isScientific = classification == "scientific";
+    analysis.isValid = validity == "true" || validity == "valid";
+    analysis.keywords = fields["keywords"];
+    analysis.keywords.erase(0, analysis.keywords.find_first_not_of(" \t\n\r"));
+    analysis.keywords.erase(analysis.keywords.find_last_not_of(" \t\n\r") + 1);
+    
+    // A scientific question is useless without keywords to search for
+    return !analysis.isScientific || !analysis.keywords.empty();
+}
+
+// Function to classify a question, extract its keywords and validate them with a single Groq call
+// The prompt asks for strict JSON; returns false if the call failed or the answer could not be parsed,
+// so the caller can fall back to the separate prompts
+bool analyzeQueryWithGroq(const string& question, QueryAnalysis& analysis) {
+    string prompt = "You are an expert in scientific research and natural language processing.\n"
+                   "Analyze the user's query below and answer three things at once.\n\n"
+                   "1. classification: \"Scientific\" if the query inquires about natural phenomena, technology, engineering,\n"
+                   "medicine, mathematics, or formal science and would be supported by research and studies;\n"
+                   "\"Not_Scientific\" if it asks for simple facts, directions, recipes, opinions, news, sports scores, or personal advice.\n"
+                   "2. keywords: the most important scientific and technical keywords or keyphrases as a single, comma-separated string.\n"
+                   "Focus on nouns, noun phrases, and technical terms; ignore stop words, interrogative words, and vague verbs.\n"
+                   "Use an empty string for Not_Scientific queries.\n"
+                   "3. valid: false if the keywords are nonsensical or unrelated to each other, don't match the query, the query is\n"
+                   "just a list of keywords/topics rather than a question or research statement, or the concepts are contradictory\n"
+                   "or impossible; true otherwise.\n\n"
+                   "Respond with ONLY a JSON object with exactly these fields and no other text:\n"
+                   "{\"classification\": \"Scientific\" or \"Not_Scientific\", \"keywords\": \"...\", \"valid\": true or false}\n\n"
+                   "-- EXAMPLES --\n"
+                   "Query: How do photovoltaic cells convert sunlight into electricity?\n"
+                   "{\"classification\": \"Scientific\", \"keywords\": \"photovoltaic cells, sunlight, electricity\", \"valid\": true}\n\n"
+                   "Query: what is the weather today?\n"
+                   "{\"classification\": \"Not_Scientific\", \"keywords\": \"\", \"valid\": true}\n\n"
+                   "Query: artificial intelligence, healthcare, technology\n"
+                   "{\"classification\": \"Scientific\", \"keywords\": \"artificial intelligence, healthcare, technology\", \"valid\": false}\n\n"
+                   "Query: Impact of Shakespeare on quantum mechanics\n"
+                   "{\"classification\": \"Scientific\", \"keywords\": \"Shakespeare, quantum mechanics\", \"valid\": false}\n"
+                   "-- END EXAMPLES --\n\n"
+                   "Now, analyze the following query.\n\n"
+                   "Query: " + question + "\n";
+    
+    // Stop as soon as the JSON object is closed
+    return parseQueryAnalysis(callGroqAPI(prompt, {150, jsonObjectComplete}), analysis);
+}
+
+// Incremental parser for Semantic Scholar search responses
+// Feed it the body in chunks as they arrive; every completed article (up to maxArticles) is appended to
+// batch and its row handed to onArticle straight away. Articles past maxArticles are dropped again.
+class SemanticScholarStreamParser {
+public:
+    SemanticScholarStreamParser(ArticleBatch& batch, size_t maxArticles, const function<void(size_t)>& onArticle)
+        : handler(batch, [this, &batch, maxArticles, &onArticle](size_t row) {
+              if (articleCount < maxArticles) {
+                  articleCount++;
+                  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                  onArticle(row);
+                  consumerSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+              } else {
+                  batch.truncate(row);
+              }
+          }),
+          parser(handler) {}
+    
+    void feed(string_view chunk) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        parser.feed(chunk);
+        feedSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    
+    // Function to end the input, returns false if the response was malformed or truncated
+    // (every article completed before the error has still been delivered)
+    bool finish() {
+        return parser.finish();
+    }
+    
+    size_t articles() const {
+        return articleCount;
+    }
+    
+    // Time spent parsing, excluding the time onArticle took
+    double parseSeconds() const {
+        return feedSeconds - consumerSeconds;
+    }
+    
+private:
+    size_t articleCount = 0;
+    double feedSeconds = 0.0;
+    double consumerSeconds = 0.0;
+    SemanticScholarHandler handler;
+    JsonStreamParser parser;
+};
+
+// Function to parse Semantic Scholar results into rows appended to batch, returns how many were added
+size_t parseSemanticScholarBatch(string_view jsonResponse, size_t maxArticles, ArticleBatch& batch) {
+    function<void(size_t)> ignore = [](size_t) {};
+    SemanticScholarStreamParser parser(batch, maxArticles, ignore);
+    parser.feed(jsonResponse);
+    
+    // A truncated or malformed response still yields every article completed before the error
+    if (!parser.finish() && parser.articles() == 0) {
+        cerr << "Warning: could not parse Semantic Scholar response" << endl;
+    }
+    batch.truncate(batch.size());  // Drop the text of an article cut off by the error
+    
+    return parser.articles();
+}
+
+// Function to parse Semantic Scholar results into Article structs
+vector<Article> parseSemanticScholarResults(const string& jsonResponse, size_t maxArticles) {
+    ArticleBatch batch;
+    parseSemanticScholarBatch(jsonResponse, maxArticles, batch);
+    
+    vector<Article> articles;
+    articles.reserve(batch.size());
+    for (size_t row = 0; row < batch.size(); row++) {
+        articles.push_back(batch.toArticle(row));
+    }
+    return articles;
+}
+
+// Append-only file read through a read-only memory mapping that is refreshed after appends
+class MappedFile {
+public:
+    ~MappedFile() {
+        close();
+    }
+    
+    // Function to open (or create) the file and map its current contents
+    bool open(const string& filePath) {
+        close();
+        path = filePath;
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        return fd >= 0 && remap();
+    }
+    
+    // Function to append bytes at the end of the file (visible in contents() after remap())
+    // Another process may append too, so callers hold a lock shared with it and refresh() first
+    bool append(string_view bytes) {
+        if (pwrite(fd, bytes.data(), bytes.size(), fileSize) != (ssize_t)bytes.size()) {
+            return false;
+        }
+        fileSize += bytes.size();
+        return true;
+    }
+    
+    // Function to cut the file back to a size (e.g. to drop a torn record)
+    bool truncate(uint64_t size) {
+        if (ftruncate(fd, size) != 0) {
+            return false;
+        }
+        return remap();
+    }
+    
+    // Function to atomically replace the file with another one and map it
+    bool replaceWith(const string& otherPath) {
+        if (rename(otherPath.c_str(), path.c_str()) != 0) {
+            return false;
+        }
+        return open(string(path));
+    }
+    
+    // Function to switch to the file now at the path if another process replaced it, then map it as it is now
+    bool refresh() {
+        struct stat opened, current;
+        if (fd >= 0 && fstat(fd, &opened) == 0 && stat(path.c_str(), &current) == 0 &&
+            (opened.st_dev != current.st_dev || opened.st_ino != current.st_ino)) {
+            return open(string(path));
+        }
+        return remap();
+    }
+    
+    // Function to map the file as it is now
+    bool remap() {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            return false;
+        }
+        if (mapped && (size_t)info.st_size == mappedSize) {
+            fileSize = info.st_size;
+            return true;  // Unchanged
+        }
+        if (mapped) {
+            munmap((void*)mapped, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+        fileSize = info.st_size;
+        if (fileSize == 0) {
+            return true;
+        }
+        void* map = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        mapped = (const char*)map;
+        mappedSize = fileSize;
+        return true;
+    }
+    
+    string_view contents() const {
+        return mapped ? string_view(mapped, mappedSize) : string_view();
+    }
+    
+    bool isOpen() const {
+        return fd >= 0;
+    }
+    
+    void close() {
+        if (mapped) {
+            munmap((void*)mapped, mappedSize);
+            mapped = nullptr;
+            mappedSize = 0;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        fileSize = 0;
+    }
+    
+private:
+    string path;
+    int fd = -1;
+    const char* mapped = nullptr;
+    size_t mappedSize = 0;
+    uint64_t fileSize = 0;
+};
+
+// Function to append an unsigned integer as a LEB128 varint
+void appendVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+// Function to read a LEB128 varint, returns false if it runs past the end
+bool readVarint(string_view data, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; pos < data.size() && shift < 64; shift += 7) {
+        unsigned char byte = data[pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to append a plain-old-data value to a byte buffer
+template <typename T>
+void appendBytes(string& out, const T& value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+// Local store of every article ever fetched, with an inverted index over titles and abstracts
+//
+// articles.bin: one record per article (ArticleRecordHeader, then paperId, title, abstract and url bytes);
+//               a document id is the record's position in the file
+// index.bin:    a sequence of immutable segments, one per batch of added articles. Each segment holds a
+//               dictionary sorted by term hash and, per term, the ids of the documents containing it as
+//               delta-encoded varints. Segments are merged into one once there are too many.
+// stats.bin:    corpus statistics for BM25 (document count, total abstract length, and the document
+//               frequency of every abstract term as parallel sorted arrays) as of some document count. It is
+//               rewritten only when the index segments are merged and when the program exits; documents
+//               added since are counted from articles.bin when the corpus is opened.
+// embeddings.bin: the embedding of every abstract as fixed-size checksummed records in document id order,
+//               so the embedding scorer does a dot product per cached article instead of embedding its text
+// The article, index and embedding files are memory-mapped, so loading costs one scan of the record headers.
+// Several processes can share the directory: every write happens under an exclusive flock on its lock file,
+// after picking up the articles, segments and embeddings the other processes have appended.
+class ArticleCorpus {
+public:
+    ~ArticleCorpus() {
+        lock_guard<mutex> lock(corpusMutex);
+        if (lockFd >= 0 && statsDocCount > savedStatsDocCount) {
+            ScopedFileLock directoryLock(lockFd);
+            saveStatistics();
+        }
+    }
+    
+    // Function to open (or create) the corpus in a directory
+    bool open(const string& directory) {
+        lock_guard<mutex> lock(corpusMutex);
+        mkdir(directory.c_str(), 0755);
+        if (lockFd >= 0) {
+            ::close(lockFd);
+        }
+        lockFd = ::open((directory + "/lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lockFd < 0 || !articleFile.open(directory + "/articles.bin") || !indexFile.open(directory + "/index.bin")) {
+            articleFile.close();
+            indexFile.close();
+            return false;
+        }
+        ScopedFileLock directoryLock(lockFd);
+        indexPath = directory + "/index.bin";
+        statsPath = directory + "/stats.bin";
+        recordOffsets.clear();
+        docIdsByPaperId.clear();
+        articleBytes = 0;
+        embeddingCount = 0;
+        loadArticles();
+        loadIndex();
+        loadStatistics();
+        if (embeddingFile.open(directory + "/embeddings.bin")) {
+            loadEmbeddings();
+        } else {
+            cerr << "Warning: could not open the article embedding cache, embeddings will be computed per query" << endl;
+        }
+        
+        // Index, embed and count anything the other files are missing (e.g. after a crash between the writes)
+        catchUp();
+        return true;
+    }
+    
+    // Function to append articles not seen before, returns how many were added
+    size_t add(const ArticleBatch& articles) {
+        lock_guard<mutex> lock(corpusMutex);
+        if (!articleFile.isOpen()) {
+            return 0;
+        }
+        ScopedFileLock directoryLock(lockFd);
+        syncWithOtherProcesses();
+        
+        vector<uint32_t> added;
+        string records;
+        uint64_t offset = articleFile.contents().size();
+        for (size_t row = 0; row < articles.size(); row++) {
+            string paperId(articles.paperId(row));
+            if (paperId.empty() || docIdsByPaperId.count(paperId)) {
+                continue;
+            }
+            uint32_t docId = (uint32_t)recordOffsets.size();
+            docIdsByPaperId[paperId] = docId;
+            recordOffsets.push_back(offset + records.size());
+            appendArticleRecord(records, articles, row);
+            added.push_back(docId);
+        }
+        
+        if (added.empty()) {
+            return 0;
+        }
+        if (!articleFile.append(records) || !articleFile.remap()) {
+            cerr << "Warning: could not write to the local article corpus" << endl;
+            articleFile.refresh();
+            loadArticles();  // Forget the offsets of whatever did not make it to the file
+            return 0;
+        }
+        articleBytes += records.size();
+        catchUp();
+        return added.size();
+    }
+    
+    // Function to get the abstract embedding of every row of a batch, from the cache where the corpus has
+    // the article and computed otherwise; returns how many came from the cache
+    size_t embeddingsFor(const ArticleBatch& articles, vector<Embedding>& embeddings) {
+        embeddings.resize(articles.size());
+        vector<size_t> uncached;
+        {
+            lock_guard<mutex> lock(corpusMutex);
+            for (size_t row = 0; row < articles.size(); row++) {
+                auto it = docIdsByPaperId.empty() ? docIdsByPaperId.end() : docIdsByPaperId.find(string(articles.paperId(row)));
+                if (it != docIdsByPaperId.end() && it->second < embeddingCount) {
+                    embeddings[row] = readEmbedding(it->second);
+                } else {
+                    uncached.push_back(row);
+                }
+            }
+        }
+        
+        // Embedding is the slow part, so it runs without holding the corpus lock
+        for (size_t row : uncached) {
+            embeddings[row] = computeEmbedding(articles.abstract(row));
+        }
+        return articles.size() - uncached.size();
+    }
+    
+    // Function to look up BM25 statistics: returns the document count and average abstract length,
+    // and fills in the document frequency of each term
+    uint32_t termStatistics(const vector<uint64_t>& terms, vector<uint32_t>& documentFrequencies, double& averageDocumentLength) {
+        lock_guard<mutex> lock(corpusMutex);
+        documentFrequencies.clear();
+        for (uint64_t term : terms) {
+            auto it = documentFrequency.find(term);
+            documentFrequencies.push_back(it == documentFrequency.end() ? 0 : it->second);
+        }
+        averageDocumentLength = statsDocCount > 0 ? (double)totalAbstractTokens / statsDocCount : 0.0;
+        return statsDocCount;
+    }
+    
+    // Function to find the articles best matching the terms of a query, rarest terms weighing most
+    ArticleBatch search(const string& query, size_t maxResults) {
+        lock_guard<mutex> lock(corpusMutex);
+        ArticleBatch results;
+        if (recordOffsets.empty()) {
+            return results;
+        }
+        
+        vector<uint64_t> terms;
+        tokenHashes(query, terms);
+        sort(terms.begin(), terms.end());
+        terms.erase(unique(terms.begin(), terms.end()), terms.end());
+        
+        unordered_map<uint32_t, double> scores;
+        vector<uint32_t> postings;
+        double documentCount = recordOffsets.size();
+        for (uint64_t term : terms) {
+            postings.clear();
+            readPostings(term, postings);
+            if (postings.empty()) {
+                continue;
+            }
+            double idf = log(1.0 + documentCount / postings.size());
+            for (uint32_t doc : postings) {
+                scores[doc] += idf;
+            }
+        }
+        
+        vector<pair<double, uint32_t>> ranked;
+        ranked.reserve(scores.size());
+        for (const auto& item : scores) {
+            ranked.push_back({item.second, item.first});
+        }
+        size_t count = min(maxResults, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+            [](const pair<double, uint32_t>& a, const pair<double, uint32_t>& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+        results.reserve(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            ArticleRecordView record = readRecord(ranked[i].second);
+            results.append(record.fields[0], record.fields[1], record.year, record.citationCount,
+                           record.fields[2], record.fields[3]);
+        }
+        return results;
+    }
+    
+    size_t size() {
+        lock_guard<mutex> lock(corpusMutex);
+        return recordOffsets.size();
+    }
+    
+private:
+    static constexpr uint32_t SEGMENT_MAGIC = 0x53495048;  // "HPIS"
+    static constexpr uint32_t STATS_MAGIC = 0x54535048;    // "HPST"
+    static constexpr size_t MAX_SEGMENTS = 16;
+    
+    struct ArticleRecordHeader {
+        uint32_t checksum;        // Of everything after this field
+        int32_t year;
+        int32_t citationCount;
+        uint32_t fieldLengths[4]; // paperId, title, abstract, url
+    };
+    
+    // A decoded record, its text pointing into the mapped file
+    struct ArticleRecordView {
+        int32_t year;
+        int32_t citationCount;
+        string_view fields[4];    // paperId, title, abstract, url
+    };
+    
+    struct EmbeddingRecord {
+        uint32_t checksum;        // Of the embedding
+        Embedding embedding;
+    };
+    
+    struct SegmentHeader {
+        uint32_t magic;
+        uint32_t termCount;
+        uint64_t postingsBytes;
+        uint32_t docLimit;        // Every document id below this is indexed once this segment exists
+        uint32_t checksum;        // Of the dictionary and postings
+    };
+    
+    struct DictionaryEntry {
+        uint64_t termHash;
+        uint64_t postingsOffset;  // Relative to the start of the segment's postings
+        uint32_t postingsLength;  // In bytes
+        uint32_t docCount;
+    };
+    
+    struct StatsHeader {
+        uint32_t magic;
+        uint32_t docCount;
+        uint64_t totalAbstractTokens;
+        uint32_t termCount;
+        uint32_t checksum;        // Of the two arrays that follow: termCount hashes, then termCount frequencies
+    };
+    
+    struct Segment {
+        string_view dictionary;   // termCount DictionaryEntry structs, sorted by termHash
+        string_view postings;
+        uint32_t termCount;
+    };
+    
+    mutex corpusMutex;
+    int lockFd = -1;                                  // Lock file shared with other processes using the directory
+    MappedFile articleFile;
+    uint64_t articleBytes = 0;                        // End of the last valid record in articles.bin
+    MappedFile indexFile;
+    string indexPath;
+    vector<uint64_t> recordOffsets;                   // Document id -> record offset in articles.bin
+    unordered_map<string, uint32_t> docIdsByPaperId;
+    vector<Segment> segments;
+    uint32_t indexedDocCount = 0;
+    string statsPath;
+    unordered_map<uint64_t, uint32_t> documentFrequency;  // Abstract term -> number of abstracts containing it
+    uint64_t totalAbstractTokens = 0;
+    uint32_t statsDocCount = 0;
+    uint32_t savedStatsDocCount = 0;                  // Documents counted in stats.bin as last read or written
+    MappedFile embeddingFile;
+    uint32_t embeddingCount = 0;                      // Documents with an embedding record
+    
+    static void appendArticleRecord(string& out, const ArticleBatch& articles, size_t row) {
+        string_view fields[4] = {articles.paperId(row), articles.title(row), articles.abstract(row), articles.url(row)};
+        ArticleRecordHeader header;
+        header.year = articles.years[row];
+        header.citationCount = articles.citationCounts[row];
+        for (int i = 0; i < 4; i++) {
+            header.fieldLengths[i] = (uint32_t)fields[i].size();
+        }
+        
+        string body;
+        body.append((const char*)&header.year, sizeof(header) - sizeof(header.checksum));
+        for (string_view field : fields) {
+            body += field;
+        }
+        header.checksum = checksumBytes(body);
+        
+        appendBytes(out, header.checksum);
+        out += body;
+    }
+    
+    // Function to decode the record at an offset, returns its total size (0 if torn or corrupt)
+    size_t decodeArticleRecord(uint64_t offset, ArticleRecordView* view) const {
+        string_view data = articleFile.contents();
+        if (offset + sizeof(ArticleRecordHeader) > data.size()) {
+            return 0;
+        }
+        ArticleRecordHeader header;
+        memcpy(&header, data.data() + offset, sizeof(header));
+        uint64_t size = sizeof(header);
+        for (uint32_t length : header.fieldLengths) {
+            size += length;
+        }
+        if (offset + size > data.size()) {
+            return 0;
+        }
+        string_view record = data.substr(offset, size);
+        if (checksumBytes(record.substr(sizeof(header.checksum))) != header.checksum) {
+            return 0;
+        }
+        
+        if (view) {
+            size_t pos = sizeof(header);
+            for (int i = 0; i < 4; i++) {
+                view->fields[i] = record.substr(pos, header.fieldLengths[i]);
+                pos += header.fieldLengths[i];
+            }
+            view->year = header.year;
+            view->citationCount = header.citationCount;
+        }
+        return size;
+    }
+    
+    ArticleRecordView readRecord(uint32_t docId) const {
+        ArticleRecordView view;
+        decodeArticleRecord(recordOffsets[docId], &view);
+        return view;
+    }
+    
+    // Function to scan the records of articles.bin not seen yet, truncating a torn final record
+    // (under the directory lock, a torn record can only be left by a writer that crashed)
+    void loadArticles() {
+        if (articleBytes > articleFile.contents().size()) {
+            // Shorter than when it was last read: the record offsets no longer hold
+            recordOffsets.clear();
+            docIdsByPaperId.clear();
+            articleBytes = 0;
+        }
+        uint64_t offset = articleBytes;
+        ArticleRecordView record;
+        while (size_t size = decodeArticleRecord(offset, &record)) {
+            docIdsByPaperId[string(record.fields[0])] = (uint32_t)recordOffsets.size();
+            recordOffsets.push_back(offset);
+            offset += size;
+        }
+        articleBytes = offset;
+        if (offset < articleFile.contents().size()) {
+            articleFile.truncate(offset);
+        }
+    }
+    
+    // Function to read what other processes have appended since this one last looked (under the directory lock)
+    void syncWithOtherProcesses() {
+        articleFile.refresh();
+        loadArticles();
+        indexFile.refresh();  // Replaced by the other process if it merged the segments
+        loadIndex();
+        if (embeddingFile.isOpen()) {
+            embeddingFile.refresh();
+            loadEmbeddings();
+        }
+    }
+    
+    // Function to index, embed and count every document of articles.bin the other files do not cover yet
+    void catchUp() {
+        uint32_t docCount = (uint32_t)recordOffsets.size();
+        bool merged = false;
+        if (indexedDocCount < docCount) {
+            merged = writeSegment(buildPostings(documentRange(indexedDocCount, docCount)), docCount);
+        }
+        if (statsDocCount < docCount) {
+            updateStatistics(documentRange(statsDocCount, docCount));
+        }
+        if (merged && statsDocCount > savedStatsDocCount) {
+            saveStatistics();  // As rarely as the index is merged, so adding stays proportional to the batch
+        }
+        if (embeddingFile.isOpen() && embeddingCount < docCount) {
+            appendEmbeddings(documentRange(embeddingCount, docCount));
+        }
+    }
+    
+    static vector<uint32_t> documentRange(uint32_t first, uint32_t end) {
+        vector<uint32_t> docIds;
+        for (uint32_t doc = first; doc < end; doc++) {
+            docIds.push_back(doc);
+        }
+        return docIds;
+    }
+    
+    // Function to count the valid records of embeddings.bin not counted yet, truncating from the first torn
+    // or corrupt one
+    void loadEmbeddings() {
+        string_view data = embeddingFile.contents();
+        size_t count = min(data.size() / sizeof(EmbeddingRecord), recordOffsets.size());
+        embeddingCount = min((size_t)embeddingCount, count);
+        while (embeddingCount < count) {
+            EmbeddingRecord record;
+            memcpy(&record, data.data() + (size_t)embeddingCount * sizeof(record), sizeof(record));
+            if (checksumBytes(string_view((const char*)&record.embedding, sizeof(record.embedding))) != record.checksum) {
+                break;
+            }
+            embeddingCount++;
+        }
+        if ((size_t)embeddingCount * sizeof(EmbeddingRecord) < data.size()) {
+            embeddingFile.truncate((size_t)embeddingCount * sizeof(EmbeddingRecord));
+        }
+    }
+    
+    Embedding readEmbedding(uint32_t docId) const {
+        EmbeddingRecord record;
+        memcpy(&record, embeddingFile.contents().data() + (size_t)docId * sizeof(record), sizeof(record));
+        return record.embedding;
+    }
+    
+    // Function to embed new documents (which must directly follow those already embedded)
+    void appendEmbeddings(const vector<uint32_t>& docIds) {
+        if (!embeddingFile.isOpen() || docIds.empty() || docIds.front() != embeddingCount) {
+            return;
+        }
+        string records;
+        records.reserve(docIds.size() * sizeof(EmbeddingRecord));
+        for (uint32_t doc : docIds) {
+            EmbeddingRecord record;
+            record.embedding = computeEmbedding(readRecord(doc).fields[2]);
+            record.checksum = checksumBytes(string_view((const char*)&record.embedding, sizeof(record.embedding)));
+            appendBytes(records, record);
+        }
+        if (!embeddingFile.append(records) || !embeddingFile.remap()) {
+            cerr << "Warning: could not write to the local embedding cache" << endl;
+            loadEmbeddings();
+            return;
+        }
+        embeddingCount += (uint32_t)docIds.size();
+    }
+    
+    // Function to read the segment directory of index.bin, truncating a torn final segment
+    void loadIndex() {
+        segments.clear();
+        indexedDocCount = 0;
+        string_view data = indexFile.contents();
+        uint64_t offset = 0;
+        while (offset + sizeof(SegmentHeader) <= data.size()) {
+            SegmentHeader header;
+            memcpy(&header, data.data() + offset, sizeof(header));
+            uint64_t dictionaryBytes = (uint64_t)header.termCount * sizeof(DictionaryEntry);
+            uint64_t end = offset + sizeof(header) + dictionaryBytes + header.postingsBytes;
+            if (header.magic != SEGMENT_MAGIC || end > data.size() || header.docLimit > recordOffsets.size() ||
+                checksumBytes(data.substr(offset + sizeof(header), end - offset - sizeof(header))) != header.checksum) {
+                break;
+            }
+            Segment segment;
+            segment.termCount = header.termCount;
+            segment.dictionary = data.substr(offset + sizeof(header), dictionaryBytes);
+            segment.postings = data.substr(offset + sizeof(header) + dictionaryBytes, header.postingsBytes);
+            segments.push_back(segment);
+            indexedDocCount = max(indexedDocCount, header.docLimit);
+            offset = end;
+        }
+        if (offset < data.size()) {
+            indexFile.truncate(offset);
+            loadIndex();
+        }
+    }
+    
+    // Function to collect (term hash, document id) pairs for documents, sorted by term then document
+    vector<pair<uint64_t, uint32_t>> buildPostings(const vector<uint32_t>& docIds) const {
+        vector<pair<uint64_t, uint32_t>> postings;
+        vector<uint64_t> terms;
+        vector<uint64_t> abstractTerms;
+        for (uint32_t doc : docIds) {
+            ArticleRecordView record = readRecord(doc);
+            tokenHashes(record.fields[1], terms);  // Title
+            tokenHashes(record.fields[2], abstractTerms);
+            terms.insert(terms.end(), abstractTerms.begin(), abstractTerms.end());
+            sort(terms.begin(), terms.end());
+            terms.erase(unique(terms.begin(), terms.end()), terms.end());
+            for (uint64_t term : terms) {
+                postings.push_back({term, doc});
+            }
+        }
+        sort(postings.begin(), postings.end());
+        return postings;
+    }
+    
+    // Function to serialize sorted (term, document) pairs as one segment
+    static string encodeSegment(const vector<pair<uint64_t, uint32_t>>& postings, uint32_t docLimit) {
+        string dictionary;
+        string encodedPostings;
+        uint32_t termCount = 0;
+        for (size_t i = 0; i < postings.size();) {
+            DictionaryEntry entry;
+            entry.termHash = postings[i].first;
+            entry.postingsOffset = encodedPostings.size();
+            entry.docCount = 0;
+            uint32_t previous = 0;
+            for (; i < postings.size() && postings[i].first == entry.termHash; i++) {
+                appendVarint(encodedPostings, postings[i].second - previous);
+                previous = postings[i].second;
+                entry.docCount++;
+            }
+            entry.postingsLength = (uint32_t)(encodedPostings.size() - entry.postingsOffset);
+            appendBytes(dictionary, entry);
+            termCount++;
+        }
+        
+        SegmentHeader header;
+        header.magic = SEGMENT_MAGIC;
+        header.termCount = termCount;
+        header.postingsBytes = encodedPostings.size();
+        header.docLimit = docLimit;
+        header.checksum = checksumBytes(dictionary + encodedPostings);
+        
+        string segment;
+        appendBytes(segment, header);
+        segment += dictionary;
+        segment += encodedPostings;
+        return segment;
+    }
+    
+    // Function to append a segment to index.bin, merging all segments once there are too many
+    // Returns whether they were merged
+    bool writeSegment(const vector<pair<uint64_t, uint32_t>>& postings, uint32_t docLimit) {
+        if (!indexFile.append(encodeSegment(postings, docLimit)) || !indexFile.remap()) {
+            cerr << "Warning: could not write to the local article index" << endl;
+            return false;
+        }
+        loadIndex();
+        if (segments.size() > MAX_SEGMENTS) {
+            mergeSegments();
+            return true;
+        }
+        return false;
+    }
+    
+    // Function to rewrite index.bin as a single segment
+    void mergeSegments() {
+        vector<pair<uint64_t, uint32_t>> postings;
+        for (const Segment& segment : segments) {
+            for (uint32_t i = 0; i < segment.termCount; i++) {
+                DictionaryEntry entry = dictionaryEntry(segment, i);
+                vector<uint32_t> docs;
+                decodePostings(segment, entry, docs);
+                for (uint32_t doc : docs) {
+                    postings.push_back({entry.termHash, doc});
+                }
+            }
+        }
+        sort(postings.begin(), postings.end());
+        
+        string tempPath = indexPath + ".tmp";
+        string merged = encodeSegment(postings, indexedDocCount);
+        int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool written = fd >= 0 && write(fd, merged.data(), merged.size()) == (ssize_t)merged.size();
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!written || !indexFile.replaceWith(tempPath)) {
+            unlink(tempPath.c_str());
+            indexFile.open(indexPath);
+        }
+        loadIndex();
+    }
+    
+    static DictionaryEntry dictionaryEntry(const Segment& segment, uint32_t i) {
+        DictionaryEntry entry;
+        memcpy(&entry, segment.dictionary.data() + (size_t)i * sizeof(DictionaryEntry), sizeof(entry));
+        return entry;
+    }
+    
+    static void decodePostings(const Segment& segment, const DictionaryEntry& entry, vector<uint32_t>& docs) {
+        string_view bytes = segment.postings.substr(entry.postingsOffset, entry.postingsLength);
+        size_t pos = 0;
+        uint64_t doc = 0;
+        uint64_t delta;
+        for (uint32_t n = 0; n < entry.docCount && readVarint(bytes, pos, delta); n++) {
+            doc += delta;
+            docs.push_back((uint32_t)doc);
+        }
+    }
+    
+    // Function to read stats.bin (a missing or corrupt file just means starting from zero)
+    void loadStatistics() {
+        documentFrequency.clear();
+        totalAbstractTokens = 0;
+        statsDocCount = 0;
+        savedStatsDocCount = 0;
+        
+        MappedFile file;
+        if (!file.open(statsPath)) {
+            return;
+        }
+        string_view data = file.contents();
+        StatsHeader header;
+        if (data.size() < sizeof(header)) {
+            return;
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        size_t arrayBytes = (size_t)header.termCount * (sizeof(uint64_t) + sizeof(uint32_t));
+        if (header.magic != STATS_MAGIC || data.size() != sizeof(header) + arrayBytes ||
+            header.docCount > recordOffsets.size() ||
+            checksumBytes(data.substr(sizeof(header))) != header.checksum) {
+            return;
+        }
+        
+        const char* hashes = data.data() + sizeof(header);
+        const char* frequencies = hashes + (size_t)header.termCount * sizeof(uint64_t);
+        documentFrequency.reserve(header.termCount);
+        for (uint32_t i = 0; i < header.termCount; i++) {
+            uint64_t hash;
+            uint32_t frequency;
+            memcpy(&hash, hashes + (size_t)i * sizeof(hash), sizeof(hash));
+            memcpy(&frequency, frequencies + (size_t)i * sizeof(frequency), sizeof(frequency));
+            documentFrequency[hash] = frequency;
+        }
+        totalAbstractTokens = header.totalAbstractTokens;
+        statsDocCount = header.docCount;
+        savedStatsDocCount = header.docCount;
+    }
+    
+    // Function to count new documents into the statistics (documents must follow those already counted)
+    void updateStatistics(const vector<uint32_t>& docIds) {
+        vector<uint64_t> terms;
+        for (uint32_t doc : docIds) {
+            tokenHashes(readRecord(doc).fields[2], terms);
+            size_t tokenCount = terms.size();
+            sort(terms.begin(), terms.end());
+            terms.erase(unique(terms.begin(), terms.end()), terms.end());
+            for (uint64_t term : terms) {
+                documentFrequency[term]++;
+            }
+            totalAbstractTokens += tokenCount;
+            statsDocCount = max(statsDocCount, doc + 1);
+        }
+    }
+    
+    // Function to rewrite stats.bin atomically
+    void saveStatistics() {
+        vector<pair<uint64_t, uint32_t>> entries(documentFrequency.begin(), documentFrequency.end());
+        sort(entries.begin(), entries.end());
+        
+        string arrays;
+        arrays.reserve(entries.size() * (sizeof(uint64_t) + sizeof(uint32_t)));
+        for (const auto& entry : entries) {
+            appendBytes(arrays, entry.first);
+        }
+        for (const auto& entry : entries) {
+            appendBytes(arrays, entry.second);
+        }
+        
+        StatsHeader header;
+        header.magic = STATS_MAGIC;
+        header.docCount = statsDocCount;
+        header.totalAbstractTokens = totalAbstractTokens;
+        header.termCount = (uint32_t)entries.size();
+        header.checksum = checksumBytes(arrays);
+        
+        string contents;
+        appendBytes(contents, header);
+        contents += arrays;
+        
+        string tempPath = statsPath + ".tmp";
+        int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        bool written = fd >= 0 && write(fd, contents.data(), contents.size()) == (ssize_t)contents.size();
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!written || rename(tempPath.c_str(), statsPath.c_str()) != 0) {
+            unlink(tempPath.c_str());
+            cerr << "Warning: could not write corpus statistics" << endl;
+            return;
+        }
+        savedStatsDocCount = statsDocCount;
+    }
+    
+    // Function to gather the documents containing a term from every segment (binary search per segment)
+    void readPostings(uint64_t term, vector<uint32_t>& docs) const {
+        for (const Segment& segment : segments) {
+            uint32_t low = 0;
+            uint32_t high = segment.termCount;
+            while (low < high) {
+                uint32_t mid = low + (high - low) / 2;
+                if (dictionaryEntry(segment, mid).termHash < term) {
+                    low = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            if (low < segment.termCount) {
+                DictionaryEntry entry = dictionaryEntry(segment, low);
+                if (entry.termHash == term) {
+                    decodePostings(segment, entry, docs);
+                }
+            }
+        }
+    }
+};
+
+// Function to get the process-wide article corpus (disabled until opened)
+ArticleCorpus& sharedArticleCorpus() {
+    static ArticleCorpus corpus;
+    return corpus;
+}
+
+// Function to switch a query context to BM25 using the corpus statistics
+// Returns false (leaving the context on cosine similarity) if the corpus has no documents yet
+bool attachBM25Statistics(QueryContext& context, const string& query, ArticleCorpus& corpus) {
+    vector<uint64_t> terms;
+    tokenHashes(query, terms);
+    sort(terms.begin(), terms.end());
+    terms.erase(unique(terms.begin(), terms.end()), terms.end());
+    
+    vector<uint32_t> documentFrequencies;
+    double averageDocumentLength;
+    uint32_t documentCount = corpus.termStatistics(terms, documentFrequencies, averageDocumentLength);
+    if (documentCount == 0 || averageDocumentLength <= 0.0) {
+        return false;
+    }
+    
+    context.queryTermIdf.clear();
+    for (size_t i = 0; i < terms.size(); i++) {
+        // A term in no abstract cannot match (candidates are counted in before scoring); keeping it
+        // would only shrink every normalized score
+        if (documentFrequencies[i] == 0) {
+            continue;
+        }
+        double df = documentFrequencies[i];
+        double idf = log(1.0 + (documentCount - df + 0.5) / (df + 0.5));
+        context.queryTermIdf.push_back({terms[i], idf});
+    }
+    context.averageDocumentLength = averageDocumentLength;
+    context.scorer = SCORER_BM25;
+    return true;
+}
+
+// Semantic Scholar returns at most this many papers per request, and offset + limit must stay within 1000
+const int SEMANTIC_SCHOLAR_PAGE_SIZE = 100;
+const int MAX_CANDIDATE_BUDGET = 1000;
+const int MIN_CANDIDATE_BUDGET = 45;
+
+// Function to run taskCount tasks on at most maxConcurrency threads
+// Tasks are handed out in index order; the call returns once all of them have finished
+void runConcurrently(size_t taskCount, size_t maxConcurrency, const function<void(size_t)>& task) {
+    atomic<size_t> nextTask(0);
+    auto worker = [&]() {
+        for (size_t i = nextTask++; i < taskCount; i = nextTask++) {
+            task(i);
+        }
+    };
+    
+    size_t threadCount = min(taskCount, max((size_t)1, maxConcurrency));
+    vector<thread> threads;
+    QueryMetrics* metrics = activeQueryMetrics;  // Helper threads report to the caller's question
+    const atomic<bool>* cancelled = activeCancellation;  // and can be cancelled along with it
+    for (size_t t = 1; t < threadCount; t++) {
+        threads.emplace_back([&worker, metrics, cancelled]() {
+            QueryMetricsScope scope(metrics);
+            CancellationScope cancellation(cancelled);
+            worker();
+        });
+    }
+    worker();  // The calling thread does its share too
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+// Function to fetch one page of Semantic Scholar search results into batch, reporting each row as it is parsed
+void fetchSemanticScholarPage(const string& query, int startYear, int currentYear, int offset, int limit,
+                              ArticleBatch& batch, const function<void(size_t)>& onArticle) {
+    string queryString = "query=" + query + 
+                         "&year=" + to_string(startYear) + "-" + to_string(currentYear) +
+                         "&offset=" + to_string(offset) +
+                         "&limit=" + to_string(limit) +
+                         "&fields=paperId,title,year,abstract,citationCount,url";
+    string url = semanticScholarApiUrl + "?" + queryString;
+    
+    // Cache hits skip the network and the rate limiter entirely
+    uint64_t cacheKey = makeCacheKey("semanticscholar", url);
+    string cachedBody;
+    unique_ptr<SemanticScholarStreamParser> parser;
+    if (sharedResponseCache().lookup(cacheKey, cachedBody)) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.endpoints[semanticScholarPolicy().name].cacheHits++; });
+        sharedRequestRecorder().record("semanticscholar", queryString, 200, cachedBody);
+        parser.reset(new SemanticScholarStreamParser(batch, limit, onArticle));
+        parser->feed(cachedBody);
+        parser->finish();
+    } else {
+        // The body is parsed while it downloads; it is only kept whole when the cache or recorder needs it
+        bool keepBody = sharedResponseCache().isOpen() || sharedRequestRecorder().isOpen();
+        size_t firstRow = batch.size();
+        unordered_set<uint64_t> reportedIds;  // paperIds a failed attempt already handed to onArticle
+        function<void(size_t)> reportNewArticle = [&](size_t row) {
+            string_view paperId = batch.paperId(row);
+            if (reportedIds.empty() || paperId.empty() || !reportedIds.count(hashTerm(paperId))) {
+                onArticle(row);
+            }
+        };
+        HttpResponse response = performWithRetry(semanticScholarPolicy(), 0, [&]() {
+            // Each attempt parses from scratch, replacing the rows of a failed attempt; the articles that
+            // attempt reported are not reported again, so they are scored and counted once
+            for (size_t row = firstRow; row < batch.size(); row++) {
+                if (!batch.paperId(row).empty()) {
+                    reportedIds.insert(hashTerm(batch.paperId(row)));
+                }
+            }
+            batch.truncate(firstRow);
+            parser.reset(new SemanticScholarStreamParser(batch, limit, reportNewArticle));
+            return sharedHttpClient().getStreaming(url, [&](string_view chunk) { parser->feed(chunk); }, keepBody);
+        });
+        
+        if (response.curlCode != CURLE_OK) {
+            if (response.curlCode != CURLE_FAILED_INIT && !searchCancelled()) {
+                cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.curlCode) << endl;
+            }
+            return;
+        }
+        if (response.status == 429) {
+            cerr << "Semantic Scholar rate limit still exceeded after retrying" << endl;
+            return;
+        }
+        
+        sharedRequestRecorder().record("semanticscholar", queryString, response.status, response.body);
+        if (response.status == 200) {
+            if (parser->finish()) {
+                if (keepBody) {
+                    sharedResponseCache().store(cacheKey, response.body, SEMANTIC_SCHOLAR_CACHE_TTL_SECONDS);
+                }
+            } else if (parser->articles() == 0) {
+                cerr << "Warning: could not parse Semantic Scholar response" << endl;
+            }
+        }
+    }
+    
+    batch.truncate(batch.size());  // Drop the text of an article cut off mid-response
+    updateQueryMetrics([&](QueryMetrics& metrics) {
+        metrics.timings.parse += parser->parseSeconds();
+        metrics.articlesParsed += parser->articles();
+    });
+}
+
+// Function to get the current calendar year (localtime_r, since queries run on several threads at once)
+int currentCalendarYear() {
+    time_t now = time(0);
+    tm local;
+    localtime_r(&now, &local);
+    return 1900 + local.tm_year;
+}
+
+// Function to search Semantic Scholar and return up to candidateBudget articles
+// Pages are fetched concurrently (at most maxConcurrency at a time), merged in rank order and
+// deduplicated by paperId
+ArticleBatch searchSemanticScholar(const string& keywords, int candidateBudget, int maxConcurrency) {
+    int currentYear = currentCalendarYear();
+    int startYear = currentYear - 25;
+    
+    string query = urlEncode(keywords);
+    candidateBudget = max(1, min(candidateBudget, MAX_CANDIDATE_BUDGET));
+    
+    size_t pageCount = (candidateBudget + SEMANTIC_SCHOLAR_PAGE_SIZE - 1) / SEMANTIC_SCHOLAR_PAGE_SIZE;
+    vector<ArticleBatch> pages(pageCount);
+    runConcurrently(pageCount, maxConcurrency, [&](size_t page) {
+        int offset = (int)page * SEMANTIC_SCHOLAR_PAGE_SIZE;
+        int limit = min(SEMANTIC_SCHOLAR_PAGE_SIZE, candidateBudget - offset);
+        fetchSemanticScholarPage(query, startYear, currentYear, offset, limit, pages[page], [](size_t) {});
+    });
+    
+    // Merge pages in order; results shift between pages while paging, so drop repeats
+    size_t rowCount = 0;
+    size_t textBytes = 0;
+    for (const ArticleBatch& page : pages) {
+        rowCount += page.size();
+        textBytes += page.textBytes();
+    }
+    ArticleBatch articles;
+    articles.reserve(rowCount, textBytes);
+    unordered_set<string_view> seenPaperIds;  // Points into the page batches, which outlive it
+    for (const ArticleBatch& page : pages) {
+        for (size_t row = 0; row < page.size(); row++) {
+            string_view paperId = page.paperId(row);
+            if (paperId.empty() || seenPaperIds.insert(paperId).second) {
+                articles.append(page, row);
+            }
+        }
+    }
+    
+    return articles;
+}
+
+// JSON handler that turns the "results" array of an OpenAlex works response into rows of a batch
+// OpenAlex ships abstracts as an inverted index ({"word": [positions]}), which is put back in word order.
+// The paperId is the work's OpenAlex id ("W123..."), and the url its DOI where it has one.
+class OpenAlexHandler : public JsonHandler {
+public:
+    explicit OpenAlexHandler(ArticleBatch& batch) : batch(batch) {}
+    
+    void onStartObject() override {
+        depth++;
+        if (inResults && depth == 3) {
+            batch.beginRow();
+            year = 0;
+            citationCount = 0;
+            workId.clear();
+            doi.clear();
+            abstractWords.clear();
+        }
+    }
+    
+    void onEndObject() override {
+        if (inResults && depth == 3) {
+            batch.setText(ArticleBatch::PAPER_ID, string_view(workId).substr(workId.rfind('/') + 1));
+            batch.setText(ArticleBatch::URL, doi.empty() ? workId : doi);
+            sort(abstractWords.begin(), abstractWords.end());
+            string abstract;
+            for (const pair<int, string>& word : abstractWords) {
+                if (!abstract.empty()) abstract += ' ';
+                abstract += word.second;
+            }
+            batch.setText(ArticleBatch::ABSTRACT, abstract);
+            batch.commitRow(year, citationCount);
+            articleCount++;
+        }
+        depth--;
+    }
+    
+    void onStartArray() override {
+        depth++;
+        if (depth == 2 && rootKey == "results") {
+            inResults = true;
+        }
+    }
+    
+    void onEndArray() override {
+        if (depth == 2) {
+            inResults = false;
+        }
+        depth--;
+    }
+    
+    void onKey(string_view key) override {
+        if (depth == 1) {
+            rootKey.assign(key);
+        } else if (inResults && depth == 3) {
+            field.assign(key);
+        } else if (inResults && depth == 4 && field == "abstract_inverted_index") {
+            word.assign(key);
+        }
+    }
+    
+    void onString(string_view value) override {
+        if (!inResults || depth != 3) return;
+        if (field == "id") workId.assign(value);
+        else if (field == "doi") doi.assign(value);
+        else if (field == "title") batch.setText(ArticleBatch::TITLE, value);
+    }
+    
+    void onNumber(string_view value) override {
+        if (!inResults) return;
+        if (depth == 3 && field == "publication_year") year = parseJsonInt(value, 0);
+        else if (depth == 3 && field == "cited_by_count") citationCount = parseJsonInt(value, 0);
+        else if (depth == 5 && field == "abstract_inverted_index") abstractWords.push_back({parseJsonInt(value, 0), word});
+    }
+    
+    size_t articles() const {
+        return articleCount;
+    }
+    
+private:
+    ArticleBatch& batch;
+    size_t articleCount = 0;
+    int year = 0;
+    int citationCount = 0;
+    string workId;
+    string doi;
+    string word;
+    vector<pair<int, string>> abstractWords;  // (position, word)
+    string rootKey;
+    string field;
+    int depth = 0;
+    bool inResults = false;
+};
+
+// OpenAlex returns at most 200 works per page; smaller pages spread a search over more parallel requests
+const int OPENALEX_PAGE_SIZE = 100;
+
+// Function to fetch one page (1-based) of OpenAlex search results into batch
+void fetchOpenAlexPage(const string& query, int startYear, int page, int perPage, ArticleBatch& batch) {
+    string queryString = "search=" + query +
+                         "&filter=from_publication_date:" + to_string(startYear) + "-01-01" +
+                         "&per-page=" + to_string(perPage) +
+                         "&page=" + to_string(page) +
+                         "&select=id,doi,title,publication_year,cited_by_count,abstract_inverted_index";
+    string url = openAlexApiUrl + "?" + queryString;
+    
+    // Cache hits skip the network and the rate limiter entirely
+    uint64_t cacheKey = makeCacheKey("openalex", url);
+    string body;
+    bool cached = sharedResponseCache().lookup(cacheKey, body);
+    if (cached) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.endpoints[openAlexPolicy().name].cacheHits++; });
+        sharedRequestRecorder().record("openalex", queryString, 200, body);
+    } else {
+        HttpResponse response = performWithRetry(openAlexPolicy(), 0, [&]() {
+            return sharedHttpClient().get(url);
+        });
+        if (response.curlCode != CURLE_OK) {
+            if (response.curlCode != CURLE_FAILED_INIT && !searchCancelled()) {
+                cerr << "curl_easy_perform() failed: " << curl_easy_strerror(response.curlCode) << endl;
+            }
+            return;
+        }
+        sharedRequestRecorder().record("openalex", queryString, response.status, response.body);
+        if (response.status != 200) {
+            cerr << "Warning: OpenAlex answered HTTP " << response.status << endl;
+            return;
+        }
+        body = move(response.body);
+    }
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t firstRow = batch.size();
+    OpenAlexHandler handler(batch);
+    JsonStreamParser parser(handler);
+    parser.feed(body);
+    if (parser.finish()) {
+        if (!cached) {
+            sharedResponseCache().store(cacheKey, body, OPENALEX_CACHE_TTL_SECONDS);
+        }
+    } else if (handler.articles() == 0) {
+        cerr << "Warning: could not parse OpenAlex response" << endl;
+    }
+    batch.truncate(batch.size());  // Drop the text of a work cut off by a parse error
+    double parseSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    updateQueryMetrics([&](QueryMetrics& metrics) {
+        metrics.timings.parse += parseSeconds;
+        metrics.articlesParsed += batch.size() - firstRow;
+    });
+}
+
+// Function to search OpenAlex and return up to candidateBudget works from the last 25 years
+// Pages are fetched concurrently (at most maxConcurrency at a time), merged in rank order and
+// deduplicated by work id
+ArticleBatch searchOpenAlex(const string& keywords, int candidateBudget, int maxConcurrency) {
+    int startYear = currentCalendarYear() - 25;
+    string query = urlEncode(keywords);
+    candidateBudget = max(1, min(candidateBudget, MAX_CANDIDATE_BUDGET));
+    
+    size_t pageCount = (candidateBudget + OPENALEX_PAGE_SIZE - 1) / OPENALEX_PAGE_SIZE;
+    int perPage = min(OPENALEX_PAGE_SIZE, candidateBudget);
+    vector<ArticleBatch> pages(pageCount);
+    runConcurrently(pageCount, maxConcurrency, [&](size_t page) {
+        fetchOpenAlexPage(query, startYear, (int)page + 1, perPage, pages[page]);
+    });
+    
+    ArticleBatch works;
+    unordered_set<string_view> seenWorkIds;  // Points into the page batches, which outlive it
+    for (const ArticleBatch& page : pages) {
+        for (size_t row = 0; row < page.size() && works.size() < (size_t)candidateBudget; row++) {
+            string_view workId = page.paperId(row);
+            if (workId.empty() || seenWorkIds.insert(workId).second) {
+                works.append(page, row);
+            }
+        }
+    }
+    return works;
+}
+
+// Keeps the best articles seen so far while search results stream in
+// A min-heap of at most capacity articles: each new article only has to beat the weakest one kept, and
+// only then is it copied out of its batch. Safe to call from several threads; repeats of a paperId are ignored.
+class TopArticleCollector {
+public:
+    explicit TopArticleCollector(size_t capacity) : capacity(capacity) {}
+    
+    // Function to offer a scored row of a batch
+    void offer(const ArticleBatch& batch, size_t row) {
+        string_view paperId = batch.paperId(row);
+        uint64_t idHash = paperId.empty() ? 0 : hashTerm(paperId);
+        double score = batch.scores[row];
+        lock_guard<mutex> lock(collectorMutex);
+        if (idHash != 0 && !seenPaperIds.insert(idHash).second) {
+            return;
+        }
+        offered++;
+        if (heap.size() < capacity) {
+            heap.push_back(batch.toArticle(row));
+            push_heap(heap.begin(), heap.end(), scoresHigher);
+        } else if (capacity > 0 && score > heap.front().relevancyScore) {
+            pop_heap(heap.begin(), heap.end(), scoresHigher);
+            heap.back() = batch.toArticle(row);
+            push_heap(heap.begin(), heap.end(), scoresHigher);
+        }
+    }
+    
+    // Function to take the kept articles, best first
+    vector<Article> takeBest() {
+        lock_guard<mutex> lock(collectorMutex);
+        sort_heap(heap.begin(), heap.end(), scoresHigher);
+        return move(heap);
+    }
+    
+    // Number of distinct articles offered
+    size_t candidateCount() {
+        lock_guard<mutex> lock(collectorMutex);
+        return offered;
+    }
+    
+private:
+    size_t capacity;
+    size_t offered = 0;
+    vector<Article> heap;              // Weakest kept article at the front
+    unordered_set<uint64_t> seenPaperIds;  // Hashes only, so memory stays small for large budgets
+    mutex collectorMutex;
+    
+    static bool scoresHigher(const Article& a, const Article& b) {
+        return a.relevancyScore > b.relevancyScore;
+    }
+};
+
+// Function to search Semantic Scholar and hand every article to onArticle as soon as it is parsed
+// Pages are fetched concurrently, so onArticle is called from several threads at once, each with its own
+// page batch and the row just added to it. If corpus is given, each page is added to it when it completes.
+void streamSemanticScholar(const string& keywords, int candidateBudget, int maxConcurrency,
+                           const function<void(ArticleBatch&, size_t)>& onArticle, ArticleCorpus* corpus) {
+    int currentYear = currentCalendarYear();
+    int startYear = currentYear - 25;
+    
+    string query = urlEncode(keywords);
+    candidateBudget = max(1, min(candidateBudget, MAX_CANDIDATE_BUDGET));
+    
+    size_t pageCount = (candidateBudget + SEMANTIC_SCHOLAR_PAGE_SIZE - 1) / SEMANTIC_SCHOLAR_PAGE_SIZE;
+    runConcurrently(pageCount, maxConcurrency, [&](size_t page) {
+        int offset = (int)page * SEMANTIC_SCHOLAR_PAGE_SIZE;
+        int limit = min(SEMANTIC_SCHOLAR_PAGE_SIZE, candidateBudget - offset);
+        
+        // Only one page of articles is held per fetch at a time
+        ArticleBatch pageArticles;
+        fetchSemanticScholarPage(query, startYear, currentYear, offset, limit, pageArticles, [&](size_t row) {
+            onArticle(pageArticles, row);
+        });
+        if (corpus) {
+            corpus->add(pageArticles);
+        }
+    });
+}
+
+// Function to display articles with relevancy scores
+void displayRankedArticles(const vector<Article>& articles) {
+    if (articles.empty()) {
+        cout << "\nNo articles found for the given keywords." << endl;
+        return;
+    }
+    
+    for (size_t i = 0; i < articles.size(); i++) {
+        cout << "\n=== Article " << (i + 1) << " ===" << endl;
+        cout << "Relevancy Score: " << fixed << setprecision(2) << articles[i].relevancyScore << "%" << endl;
+        cout << "Title: " << articles[i].title << endl;
+        cout << "Year: " << (articles[i].year > 0 ? to_string(articles[i].year) : "N/A") << endl;
+        cout << "Citations: " << articles[i].citationCount << endl;
+        
+        if (!articles[i].abstract.empty()) {
+            string_view abstract = articles[i].abstract;
+            if (abstract.length() > 300) {
+                cout << "Abstract: " << abstract.substr(0, 297) << "..." << endl;
+            } else {
+                cout << "Abstract: " << abstract << endl;
+            }
+        } else {
+            cout << "Abstract: N/A" << endl;
+        }
+        
+        cout << "URL: " << articles[i].url << endl;
+    }
+    
+    cout << "\n--- Total articles found: " << articles.size() << " ---" << endl;
+}
+
+// Structure to hold a request received by the local HTTP server
+struct HttpServerRequest {
+    string method;
+    string target;                          // Path and query string as sent
+    string path;                            // Target without the query string
+    unordered_map<string, string> headers;  // Lowercased names
+    string body;
+};
+
+// Structure to hold a response produced by a server handler
+struct HttpServerResponse {
+    int status = 200;
+    string contentType = "application/json";
+    vector<pair<string, string>> headers;   // Extra headers
+    string body;
+};
+
+// Set by SIGINT/SIGTERM to make running servers shut down
+atomic<bool> serverStopRequested(false);
+
+// Function to get the reason phrase of an HTTP status code
+const char* httpStatusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+// Minimal HTTP/1.1 server on POSIX sockets
+// One thread accepts connections and queues them; a fixed pool of workers reads each request, runs the
+// handler and answers with "Connection: close". When the queue is full, new connections are answered
+// with 503 and Retry-After right away, so callers see backpressure instead of unbounded latency.
+class HttpServer {
+public:
+    typedef function<HttpServerResponse(const HttpServerRequest&)> Handler;
+    
+    HttpServer(Handler handler, int workerCount, size_t queueCapacity)
+        : handler(move(handler)), workerCount(max(1, workerCount)), queueCapacity(max((size_t)1, queueCapacity)) {}
+    
+    ~HttpServer() {
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+    }
+    
+    // Function to bind and listen on address:port (port 0 picks a free port), returns false on error
+    bool listen(const string& address, int port) {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1 ||
+            ::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listenFd, 128) != 0) {
+            ::close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        
+        socklen_t length = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &length);
+        boundPort = ntohs(addr.sin_port);
+        return true;
+    }
+    
+    int port() const {
+        return boundPort;
+    }
+    
+    // Function to serve until stop() is called or a stop signal arrives
+    void run() {
+        vector<thread> workers;
+        for (int i = 0; i < workerCount; i++) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        
+        while (!stopping && !serverStopRequested) {
+            pollfd pfd{listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0) {
+                continue;
+            }
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd < 0) {
+                continue;
+            }
+            timeval timeout{10, 0};
+            setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            
+            unique_lock<mutex> lock(queueMutex);
+            if (pending.size() >= queueCapacity) {
+                lock.unlock();
+                HttpServerResponse busy;
+                busy.status = 503;
+                busy.headers.push_back({"Retry-After", "1"});
+                busy.body = "{\"error\":\"server busy, retry later\"}";
+                sendResponse(clientFd, busy);
+                ::close(clientFd);
+                continue;
+            }
+            pending.push_back(clientFd);
+            lock.unlock();
+            queueReady.notify_one();
+        }
+        
+        // Let workers finish what is already queued
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+    
+    void stop() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueReady.notify_all();
+    }
+    
+private:
+    static const size_t MAX_HEADER_BYTES = 16 * 1024;
+    static const size_t MAX_BODY_BYTES = 1024 * 1024;
+    
+    Handler handler;
+    int workerCount;
+    size_t queueCapacity;
+    int listenFd = -1;
+    int boundPort = 0;
+    bool stopping = false;
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<int> pending;
+    
+    void workerLoop() {
+        while (true) {
+            int clientFd;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueReady.wait(lock, [this]() { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                clientFd = pending.front();
+                pending.pop_front();
+            }
+            handleConnection(clientFd);
+            ::close(clientFd);
+        }
+    }
+    
+    void handleConnection(int clientFd) {
+        HttpServerRequest request;
+        int error = readRequest(clientFd, request);
+        if (error != 0) {
+            HttpServerResponse response;
+            response.status = error;
+            response.body = string("{\"error\":\"") + httpStatusText(error) + "\"}";
+            sendResponse(clientFd, response);
+            return;
+        }
+        
+        HttpServerResponse response;
+        try {
+            response = handler(request);
+        } catch (const exception& e) {
+            response = HttpServerResponse();
+            response.status = 500;
+            response.body = "{\"error\":\"" + escapeJson(e.what()) + "\"}";
+        }
+        sendResponse(clientFd, response);
+    }
+    
+    // Function to read one request, returns 0 or the HTTP status to answer a malformed request with
+    static int readRequest(int clientFd, HttpServerRequest& request) {
+        string data;
+        char buffer[8192];
+        size_t headerEnd;
+        while ((headerEnd = data.find("\r\n\r\n")) == string::npos) {
+            if (data.size() > MAX_HEADER_BYTES) {
+                return 413;
+            }
+            ssize_t received = recv(clientFd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                return 400;
+            }
+            data.append(buffer, received);
+        }
+        
+        istringstream head(data.substr(0, headerEnd));
+        string requestLine;
+        getline(head, requestLine);
+        istringstream requestLineStream(requestLine);
+        string version;
+        if (!(requestLineStream >> request.method >> request.target >> version)) {
+            return 400;
+        }
+        request.path = request.target.substr(0, request.target.find('?'));
+        
+        string line;
+        while (getline(head, line)) {
+            size_t colon = line.find(':');
+            if (colon == string::npos) {
+                continue;
+            }
+            string name = toLowercase(line.substr(0, colon));
+            string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t\r") + 1);
+            request.headers[name] = value;
+        }
+        
+        size_t contentLength = 0;
+        auto lengthHeader = request.headers.find("content-length");
+        if (lengthHeader != request.headers.end()) {
+            from_chars_result parsed = from_chars(lengthHeader->second.data(),
+                                                 lengthHeader->second.data() + lengthHeader->second.size(), contentLength);
+            if (parsed.ec != errc()) {
+                return 400;
+            }
+        }
+        if (contentLength > MAX_BODY_BYTES) {
+            return 413;
+        }
+        
+        request.body = data.substr(headerEnd + 4);
+        while (request.body.size() < contentLength) {
+            ssize_t received = recv(clientFd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                return 400;
+            }
+            request.body.append(buffer, received);
+        }
+        request.body.resize(contentLength);
+        return 0;
+    }
+    
+    static void sendResponse(int clientFd, const HttpServerResponse& response) {
+        ostringstream head;
+        head << "HTTP/1.1 " << response.status << " " << httpStatusText(response.status) << "\r\n"
+             << "Content-Type: " << response.contentType << "\r\n"
+             << "Content-Length: " << response.body.size() << "\r\n"
+             << "Connection: close\r\n";
+        for (const auto& header : response.headers) {
+            head << header.first << ": " << header.second << "\r\n";
+        }
+        head << "\r\n";
+        
+        string message = head.str() + response.body;
+        size_t sent = 0;
+        while (sent < message.size()) {
+            ssize_t written = send(clientFd, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                return;
+            }
+            sent += written;
+        }
+    }
+};
+
+// Function to make SIGINT/SIGTERM stop running servers gracefully
+void installServerStopHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = [](int) { serverStopRequested = true; };
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+// Structure to hold command line options
+struct ProgramOptions {
+    bool pipeline = false;     // Overlap the classify / extract / validate / search stages
+    bool combinedPrompt = false;  // Classify, extract and validate with one structured LLM call
+    bool llmStreaming = true;  // Stream Groq answers and stop reading once they are known
+    int candidateBudget = 45;  // Number of candidate articles fetched from Semantic Scholar
+    int fetchConcurrency = 4;  // Maximum number of result pages fetched at the same time
+    bool useCache = true;      // Reuse API responses from the on-disk cache
+    string cacheDirectory = ".honors_cache";
+    int cacheMaxMegabytes = 64;
+    bool recordCorpus = true;  // Append fetched articles to the local corpus
+    bool localFirst = false;   // Answer from the local corpus when it has enough matches
+    bool offline = false;      // Answer only from the local corpus
+    string corpusDirectory = ".honors_corpus";
+    SimilarityScorer scorer = SCORER_COSINE;  // Text similarity component of the relevancy score
+    string batchInput;         // File of questions to answer as JSON lines ("-" = stdin), empty = interactive
+    int batchConcurrency = 4;  // Questions processed at the same time in batch mode
+    int servePort = -1;        // Port of the local HTTP/JSON endpoint, -1 = not serving
+    int serverWorkers = 4;     // Questions answered at the same time in server mode
+    int serverQueueSize = 64;  // Connections waiting for a worker before new ones get 503
+    vector<int> benchmarkSizes;    // Papers per synthetic payload, empty = no benchmark
+    int benchmarkIterations = 5;   // Times each payload is parsed and scored
+    string groqUrl = GROQ_API_URL;
+    string semanticScholarUrl = SEMANTIC_SCHOLAR_API_URL;
+    string recordOutput;           // JSON-lines file every API request/response is appended to
+    string replayInput;            // Recording served by the stand-in server (with --serve)
+    double replayLatencyMs = 0.0;  // Delay added to every stand-in response
+    double replayJitterMs = 0.0;   // Random +/- variation of that delay
+    double replay429Rate = 0.0;    // Share of stand-in requests answered with 429
+    string loadInput;              // Questions cycled through by the load driver, empty = no load run
+    double loadRate = 1.0;         // Questions started per second
+    int loadDurationSeconds = 10;
+    bool emitMetrics = false;      // Report per-question timers and counters
+    bool streamResults = false;    // Score search results while they download, keeping only the best
+    vector<string> sources = {"semanticscholar"};  // Article sources searched at once (see makeArticleSource)
+    int deadlineMs = 0;            // Time allowed for the sources to answer, 0 = wait for all of them
+    string openAlexUrl = OPENALEX_API_URL;
+    int topCount = 15;             // Number of ranked articles returned
+    bool mergeDuplicates = true;   // Merge near-duplicate candidates (preprint / journal versions) before scoring
+    string classifierPath;         // Weights of the local question classifier, empty = always ask the LLM
+    double classifierThreshold = 0.9;  // Probability the classifier needs (either way) to answer without the LLM
+    bool classifierShadow = false; // Ask the LLM even when the classifier is confident, and count agreement
+    string classifierLogPath;      // File every LLM classification is appended to, as training data
+    string trainClassifierInput;   // Classification log to train the classifier weights from
+};
+
+// A local answer is used instead of searching Semantic Scholar once it has at least this many articles
+const size_t MIN_LOCAL_RESULTS = 15;
+
+// Function to print command line usage
+void printUsage(const char* program) {
+    cout << "Usage: " << program << " [--pipeline] [--combined] [--no-llm-stream] [--candidates N] [--fetch-concurrency N] [--no-cache] [--cache-dir DIR] [--cache-size MB]"
+         << " [--local | --offline] [--no-corpus] [--corpus-dir DIR] [--scorer cosine|bm25|embedding]"
+         << " [--batch FILE] [--concurrency N] [--serve PORT] [--workers N] [--queue-size N]"
+         << " [--benchmark SIZES] [--benchmark-iterations N] [--groq-url URL] [--semantic-scholar-url URL] [--openalex-url URL]"
+         << " [--record FILE] [--replay FILE] [--replay-latency MS] [--replay-jitter MS] [--replay-429-rate P]"
+         << " [--load FILE] [--rate N] [--duration S] [--metrics] [--stream] [--top K] [--keep-duplicates]"
+         << " [--sources LIST] [--deadline MS]"
+         << " [--classifier FILE] [--classifier-threshold P] [--classifier-shadow] [--classifier-log FILE] [--train-classifier LOG]" << endl;
+    cout << "  --pipeline             Classify and extract keywords concurrently, and search while validation is in flight" << endl;
+    cout << "  --combined             Classify, extract keywords and validate with one JSON-answering LLM call," << endl;
+    cout << "                         falling back to the separate calls if the answer is malformed" << endl;
+    cout << "  --no-llm-stream        Wait for whole Groq answers instead of streaming them and stopping once they are known" << endl;
+    cout << "  --candidates N         Number of candidate articles to fetch (" << MIN_CANDIDATE_BUDGET << "-" << MAX_CANDIDATE_BUDGET << ", default 45)" << endl;
+    cout << "  --fetch-concurrency N  Maximum number of result pages fetched at once (default 4)" << endl;
+    cout << "  --no-cache             Always call the APIs instead of reusing cached responses" << endl;
+    cout << "  --cache-dir DIR        Directory of the response cache (default .honors_cache)" << endl;
+    cout << "  --cache-size MB        Size the response cache is trimmed to (default 64)" << endl;
+    cout << "  --local                Answer from the local article corpus, searching Semantic Scholar only if it has fewer than " << MIN_LOCAL_RESULTS << " matches" << endl;
+    cout << "  --offline              Answer only from the local article corpus" << endl;
+    cout << "  --no-corpus            Do not add fetched articles to the local corpus" << endl;
+    cout << "  --corpus-dir DIR       Directory of the local article corpus (default .honors_corpus)" << endl;
+    cout << "  --scorer cosine|bm25|embedding" << endl;
+    cout << "                         Text similarity used in the relevancy score (default cosine; bm25 uses corpus statistics," << endl;
+    cout << "                         embedding compares hashed n-gram vectors cached in the corpus)" << endl;
+    cout << "  --batch FILE           Answer every question in FILE (one per line, - for stdin), printing one JSON line each" << endl;
+    cout << "  --concurrency N        Questions processed at the same time in batch mode (default 4)" << endl;
+    cout << "  --serve PORT           Run as a server on 127.0.0.1:PORT; POST /query with {\"question\": \"...\"}" << endl;
+    cout << "  --workers N            Questions answered at the same time in server mode (default 4)" << endl;
+    cout << "  --queue-size N         Requests allowed to wait for a worker before the server answers 503 (default 64)" << endl;
+    cout << "  --benchmark SIZES      Time parsing, tokenizing, scoring and sorting on synthetic payloads, e.g. 45,1000,10000" << endl;
+    cout << "  --benchmark-iterations N  Times each benchmark payload is processed (default 5)" << endl;
+    cout << "  --groq-url URL         Groq chat completions endpoint (default " << GROQ_API_URL << ")" << endl;
+    cout << "  --semantic-scholar-url URL  Semantic Scholar search endpoint (default " << SEMANTIC_SCHOLAR_API_URL << ")" << endl;
+    cout << "  --openalex-url URL     OpenAlex works endpoint (default " << OPENALEX_API_URL << ")" << endl;
+    cout << "  --record FILE          Append every API request and response to FILE for --replay" << endl;
+    cout << "  --replay FILE          With --serve, act as a stand-in for both APIs that answers from a recording" << endl;
+    cout << "  --replay-latency MS    Delay of every stand-in response (default 0)" << endl;
+    cout << "  --replay-jitter MS     Random +/- variation of the stand-in delay (default 0)" << endl;
+    cout << "  --replay-429-rate P    Share of stand-in requests answered with 429, 0-1 (default 0)" << endl;
+    cout << "  --load FILE            Send the questions in FILE at --rate per second for --duration seconds and report latencies" << endl;
+    cout << "  --rate N               Questions started per second by --load (default 1)" << endl;
+    cout << "  --duration S           Length of a --load run in seconds (default 10)" << endl;
+    cout << "  --metrics              Report stage timings, network timings and counters of every question as JSON" << endl;
+    cout << "  --stream               Score search results while they download instead of after the whole search" << endl;
+    cout << "  --top K                Number of ranked articles to show (default 15)" << endl;
+    cout << "  --keep-duplicates      Score near-duplicate articles (e.g. preprint and journal versions) separately" << endl;
+    cout << "  --sources LIST         Comma-separated article sources searched at once: semanticscholar, openalex, corpus" << endl;
+    cout << "                         (default semanticscholar)" << endl;
+    cout << "  --deadline MS          Drop sources that have not answered after MS milliseconds (default 0 = wait for all)" << endl;
+    cout << "  --classifier FILE      Classify questions locally with these weights, asking the LLM only when unsure" << endl;
+    cout << "  --classifier-threshold P" << endl;
+    cout << "                         Confidence (0.5-1) the local classifier needs to answer alone (default 0.9)" << endl;
+    cout << "  --classifier-shadow    Ask the LLM anyway and count how often it agrees with the confident local answers" << endl;
+    cout << "  --classifier-log FILE  Append every LLM classification to FILE as training data" << endl;
+    cout << "  --train-classifier LOG Train weights from a --classifier-log file, write them to --classifier FILE and exit" << endl;
+}
+
+// Function to read the integer value of a command line option, returns false if missing or malformed
+bool readIntOption(int argc, char* argv[], int& i, int& value) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    string text = argv[++i];
+    from_chars_result parsed = from_chars(text.data(), text.data() + text.size(), value);
+    return parsed.ec == errc() && parsed.ptr == text.data() + text.size();
+}
+
+// Function to read the decimal value of a command line option, returns false if missing or malformed
+bool readDoubleOption(int argc, char* argv[], int& i, double& value) {
+    if (i + 1 >= argc) {
+        return false;
+    }
+    string text = argv[++i];
+    from_chars_result parsed = from_chars(text.data(), text.data() + text.size(), value);
+    return parsed.ec == errc() && parsed.ptr == text.data() + text.size();
+}
+
+// Function to parse command line options, returns false if the program should exit
+bool parseProgramOptions(int argc, char* argv[], ProgramOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--pipeline") {
+            options.pipeline = true;
+        } else if (arg == "--combined") {
+            options.combinedPrompt = true;
+        } else if (arg == "--no-llm-stream") {
+            options.llmStreaming = false;
+        } else if (arg == "--candidates") {
+            if (!readIntOption(argc, argv, i, options.candidateBudget) ||
+                options.candidateBudget < MIN_CANDIDATE_BUDGET || options.candidateBudget > MAX_CANDIDATE_BUDGET) {
+                cerr << "--candidates must be between " << MIN_CANDIDATE_BUDGET << " and " << MAX_CANDIDATE_BUDGET << endl;
+                return false;
+            }
+        } else if (arg == "--no-cache") {
+            options.useCache = false;
+        } else if (arg == "--cache-dir") {
+            if (i + 1 >= argc) {
+                cerr << "--cache-dir needs a directory" << endl;
+                return false;
+            }
+            options.cacheDirectory = argv[++i];
+        } else if (arg == "--cache-size") {
+            if (!readIntOption(argc, argv, i, options.cacheMaxMegabytes) || options.cacheMaxMegabytes < 1) {
+                cerr << "--cache-size must be at least 1" << endl;
+                return false;
+            }
+        } else if (arg == "--local") {
+            options.localFirst = true;
+        } else if (arg == "--offline") {
+            options.offline = true;
+        } else if (arg == "--no-corpus") {
+            options.recordCorpus = false;
+        } else if (arg == "--corpus-dir") {
+            if (i + 1 >= argc) {
+                cerr << "--corpus-dir needs a directory" << endl;
+                return false;
+            }
+            options.corpusDirectory = argv[++i];
+        } else if (arg == "--scorer") {
+            string scorer = i + 1 < argc ? argv[++i] : "";
+            if (scorer == "cosine") {
+                options.scorer = SCORER_COSINE;
+            } else if (scorer == "bm25") {
+                options.scorer = SCORER_BM25;
+            } else if (scorer == "embedding") {
+                options.scorer = SCORER_EMBEDDING;
+            } else {
+                cerr << "--scorer must be cosine, bm25 or embedding" << endl;
+                return false;
+            }
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc) {
+                cerr << "--batch needs a file (or - for stdin)" << endl;
+                return false;
+            }
+            options.batchInput = argv[++i];
+        } else if (arg == "--concurrency") {
+            if (!readIntOption(argc, argv, i, options.batchConcurrency) || options.batchConcurrency < 1) {
+                cerr << "--concurrency must be at least 1" << endl;
+                return false;
+            }
+        } else if (arg == "--benchmark") {
+            if (i + 1 >= argc) {
+                cerr << "--benchmark needs a comma-separated list of sizes" << endl;
+                return false;
+            }
+            stringstream sizes(argv[++i]);
+            string size;
+            options.benchmarkSizes.clear();
+            while (getline(sizes, size, ',')) {
+                int papers = 0;
+                from_chars_result parsed = from_chars(size.data(), size.data() + size.size(), papers);
+                if (parsed.ec != errc() || parsed.ptr != size.data() + size.size() || papers < 1 || papers > 100000) {
+                    cerr << "--benchmark sizes must be between 1 and 100000 papers" << endl;
+                    return false;
+                }
+                options.benchmarkSizes.push_back(papers);
+            }
+            if (options.benchmarkSizes.empty()) {
+                cerr << "--benchmark needs a comma-separated list of sizes" << endl;
+                return false;
+            }
+        } else if (arg == "--benchmark-iterations") {
+            if (!readIntOption(argc, argv, i, options.benchmarkIterations) || options.benchmarkIterations < 1) {
+                cerr << "--benchmark-iterations must be at least 1" << endl;
+                return false;
+            }
+        } else if (arg == "--metrics") {
+            options.emitMetrics = true;
+        } else if (arg == "--stream") {
+            options.streamResults = true;
+        } else if (arg == "--top") {
+            if (!readIntOption(argc, argv, i, options.topCount) || options.topCount < 1 || options.topCount > MAX_CANDIDATE_BUDGET) {
+                cerr << "--top must be between 1 and " << MAX_CANDIDATE_BUDGET << endl;
+                return false;
+            }
+        } else if (arg == "--keep-duplicates") {
+            options.mergeDuplicates = false;
+        } else if (arg == "--sources") {
+            stringstream names(i + 1 < argc ? argv[++i] : "");
+            string name;
+            options.sources.clear();
+            while (getline(names, name, ',')) {
+                if (name != "semanticscholar" && name != "openalex" && name != "corpus") {
+                    cerr << "--sources takes semanticscholar, openalex and corpus, not " << name << endl;
+                    return false;
+                }
+                if (find(options.sources.begin(), options.sources.end(), name) == options.sources.end()) {
+                    options.sources.push_back(name);
+                }
+            }
+            if (options.sources.empty()) {
+                cerr << "--sources needs a comma-separated list of sources" << endl;
+                return false;
+            }
+        } else if (arg == "--deadline") {
+            if (!readIntOption(argc, argv, i, options.deadlineMs) || options.deadlineMs < 0) {
+                cerr << "--deadline must be a number of milliseconds" << endl;
+                return false;
+            }
+        } else if (arg == "--groq-url" || arg == "--semantic-scholar-url" || arg == "--openalex-url") {
+            if (i + 1 >= argc) {
+                cerr << arg << " needs a URL" << endl;
+                return false;
+            }
+            (arg == "--groq-url" ? options.groqUrl
+                : arg == "--semantic-scholar-url" ? options.semanticScholarUrl : options.openAlexUrl) = argv[++i];
+        } else if (arg == "--record" || arg == "--replay" || arg == "--load") {
+            if (i + 1 >= argc) {
+                cerr << arg << " needs a file name" << endl;
+                return false;
+            }
+            (arg == "--record" ? options.recordOutput : arg == "--replay" ? options.replayInput : options.loadInput) = argv[++i];
+        } else if (arg == "--replay-latency" || arg == "--replay-jitter") {
+            double& value = arg == "--replay-latency" ? options.replayLatencyMs : options.replayJitterMs;
+            if (!readDoubleOption(argc, argv, i, value) || value < 0) {
+                cerr << arg << " must be a number of milliseconds" << endl;
+                return false;
+            }
+        } else if (arg == "--replay-429-rate") {
+            if (!readDoubleOption(argc, argv, i, options.replay429Rate) || options.replay429Rate < 0 || options.replay429Rate > 1) {
+                cerr << "--replay-429-rate must be between 0 and 1" << endl;
+                return false;
+            }
+        } else if (arg == "--rate") {
+            if (!readDoubleOption(argc, argv, i, options.loadRate) || options.loadRate <= 0) {
+                cerr << "--rate must be a positive number of questions per second" << endl;
+                return false;
+            }
+        } else if (arg == "--duration") {
+            if (!readIntOption(argc, argv, i, options.loadDurationSeconds) || options.loadDurationSeconds < 1) {
+                cerr << "--duration must be at least 1 second" << endl;
+                return false;
+            }
+        } else if (arg == "--serve") {
+            if (!readIntOption(argc, argv, i, options.servePort) || options.servePort < 0 || options.servePort > 65535) {
+                cerr << "--serve needs a port number" << endl;
+                return false;
+            }
+        } else if (arg == "--workers") {
+            if (!readIntOption(argc, argv, i, options.serverWorkers) || options.serverWorkers < 1) {
+                cerr << "--workers must be at least 1" << endl;
+                return false;
+            }
+        } else if (arg == "--queue-size") {
+            if (!readIntOption(argc, argv, i, options.serverQueueSize) || options.serverQueueSize < 1) {
+                cerr << "--queue-size must be at least 1" << endl;
+                return false;
+            }
+        } else if (arg == "--classifier" || arg == "--classifier-log" || arg == "--train-classifier") {
+            if (i + 1 >= argc) {
+                cerr << arg << " needs a file name" << endl;
+                return false;
+            }
+            (arg == "--classifier" ? options.classifierPath
+                : arg == "--classifier-log" ? options.classifierLogPath : options.trainClassifierInput) = argv[++i];
+        } else if (arg == "--classifier-threshold") {
+            if (!readDoubleOption(argc, argv, i, options.classifierThreshold) ||
+                options.classifierThreshold < 0.5 || options.classifierThreshold > 1) {
+                cerr << "--classifier-threshold must be between 0.5 and 1" << endl;
+                return false;
+            }
+        } else if (arg == "--classifier-shadow") {
+            options.classifierShadow = true;
+        } else if (arg == "--fetch-concurrency") {
+            if (!readIntOption(argc, argv, i, options.fetchConcurrency) || options.fetchConcurrency < 1) {
+                cerr << "--fetch-concurrency must be at least 1" << endl;
+                return false;
+            }
+        } else {
+            printUsage(argv[0]);
+            return arg == "--help" || arg == "-h";
+        }
+    }
+    return true;
+}
+
+// Near-duplicate detection: the preprint, conference and journal versions of a work get separate records.
+// Each article's title and abstract are reduced to a MinHash signature over word shingles, and banded LSH
+// puts articles whose signatures share a band in the same bucket, so clustering stays linear in the articles.
+const size_t MINHASH_SIGNATURE_SIZE = 32;
+const size_t MINHASH_BANDS = 8;                // 4 hashes per band: pairs ~0.6 similar share a band half the time
+const size_t SHINGLE_WORDS = 3;                // Words per shingle
+const size_t MIN_SHINGLES = 4;                 // Shorter texts are too little evidence to merge on
+const double NEAR_DUPLICATE_SIMILARITY = 0.7;  // Estimated Jaccard similarity that makes two records one work
+
+typedef array<uint32_t, MINHASH_SIGNATURE_SIZE> MinHashSignature;
+
+// Function to scramble a 64-bit value (the splitmix64 finalizer)
+inline uint64_t mixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Function to compute the MinHash signature of an article, returns false if its text is too short to compare
+// Title and abstract are normalized by the tokenizer (lowercase words without punctuation) and read as one text
+bool computeMinHash(string_view title, string_view abstract, MinHashSignature& signature) {
+    thread_local vector<uint64_t> words;
+    thread_local vector<uint64_t> abstractWords;
+    tokenHashes(title, words);
+    tokenHashes(abstract, abstractWords);
+    words.insert(words.end(), abstractWords.begin(), abstractWords.end());
+    if (words.size() < SHINGLE_WORDS + MIN_SHINGLES - 1) {
+        return false;
+    }
+    
+    static const pair<MinHashSignature, MinHashSignature> constants = []() {
+        pair<MinHashSignature, MinHashSignature> values;
+        for (size_t k = 0; k < MINHASH_SIGNATURE_SIZE; k++) {
+            values.first[k] = (uint32_t)mixHash(2 * k + 1) | 1;  // Odd, so each hash is a bijection
+            values.second[k] = (uint32_t)mixHash(2 * k + 2);
+        }
+        return values;
+    }();
+    const MinHashSignature& multipliers = constants.first;
+    const MinHashSignature& offsets = constants.second;
+    
+    signature.fill(UINT32_MAX);
+    for (size_t start = 0; start + SHINGLE_WORDS <= words.size(); start++) {
+        uint64_t shingle = 0;
+        for (size_t w = 0; w < SHINGLE_WORDS; w++) {
+            shingle = mixHash(shingle ^ words[start + w]);
+        }
+        // Each signature slot is the minimum under its own hash function. The shingle hash is already well
+        // mixed, so a 32-bit multiply-add per slot is enough to derive them, and the loop vectorizes.
+        uint32_t folded = (uint32_t)(shingle ^ (shingle >> 32));
+        for (size_t k = 0; k < MINHASH_SIGNATURE_SIZE; k++) {
+            signature[k] = min(signature[k], folded * multipliers[k] + offsets[k]);
+        }
+    }
+    return true;
+}
+
+// Function to estimate the Jaccard similarity of two shingle sets from their signatures
+double minHashSimilarity(const MinHashSignature& a, const MinHashSignature& b) {
+    size_t equal = 0;
+    for (size_t k = 0; k < MINHASH_SIGNATURE_SIZE; k++) {
+        equal += a[k] == b[k];
+    }
+    return (double)equal / MINHASH_SIGNATURE_SIZE;
+}
+
+// Function to merge near-duplicate articles, returns how many rows were removed
+// Each cluster keeps one representative (an article with an abstract first, then the most cited, then the
+// earliest) at its original position, with the highest citation count of the cluster.
+// The versions count citations of the same work, so adding them up would double count (and could overflow).
+// Every article is compared only with the first article of each of its LSH buckets, so the cost is linear.
+size_t mergeNearDuplicates(ArticleBatch& articles) {
+    size_t count = articles.size();
+    vector<MinHashSignature> signatures(count);
+    vector<uint32_t> cluster(count);
+    for (size_t row = 0; row < count; row++) {
+        cluster[row] = (uint32_t)row;
+    }
+    auto findCluster = [&](uint32_t row) {
+        while (cluster[row] != row) {
+            cluster[row] = cluster[cluster[row]];  // Path halving
+            row = cluster[row];
+        }
+        return row;
+    };
+    
+    const size_t ROWS_PER_BAND = MINHASH_SIGNATURE_SIZE / MINHASH_BANDS;
+    unordered_map<uint64_t, uint32_t> buckets;
+    buckets.reserve(count * MINHASH_BANDS);
+    size_t merges = 0;
+    for (size_t row = 0; row < count; row++) {
+        if (!computeMinHash(articles.title(row), articles.abstract(row), signatures[row])) {
+            continue;
+        }
+        for (size_t band = 0; band < MINHASH_BANDS; band++) {
+            uint64_t key = band;
+            for (size_t k = band * ROWS_PER_BAND; k < (band + 1) * ROWS_PER_BAND; k++) {
+                key = mixHash(key ^ signatures[row][k]);
+            }
+            auto bucket = buckets.emplace(key, (uint32_t)row);
+            if (bucket.second) {
+                continue;
+            }
+            uint32_t first = findCluster(bucket.first->second);
+            uint32_t current = findCluster((uint32_t)row);
+            if (first != current && minHashSimilarity(signatures[row], signatures[bucket.first->second]) >= NEAR_DUPLICATE_SIMILARITY) {
+                cluster[max(first, current)] = min(first, current);
+                merges++;
+            }
+        }
+    }
+    if (merges == 0) {
+        return 0;
+    }
+    
+    // Pick each cluster's representative and the highest citation count of its versions
+    vector<uint32_t> representative(count, UINT32_MAX);
+    vector<int> citations(count, 0);
+    for (size_t row = 0; row < count; row++) {
+        uint32_t root = findCluster((uint32_t)row);
+        citations[root] = max(citations[root], articles.citationCounts[row]);
+        uint32_t& best = representative[root];
+        if (best == UINT32_MAX ||
+            make_pair(!articles.abstract(row).empty(), articles.citationCounts[row]) >
+            make_pair(!articles.abstract(best).empty(), articles.citationCounts[best])) {
+            best = (uint32_t)row;
+        }
+    }
+    
+    ArticleBatch merged;
+    merged.reserve(count - merges, articles.textBytes());
+    for (size_t row = 0; row < count; row++) {
+        uint32_t root = findCluster((uint32_t)row);
+        if (representative[root] == row) {
+            merged.append(articles, row);
+            merged.citationCounts.back() = citations[root];
+        }
+    }
+    articles = move(merged);
+    return merges;
+}
+
+// Structure to hold the candidate articles retrieved for a question
+// A streamed search scores articles as they arrive and keeps only the best, so they come back ranked
+struct CandidateSet {
+    ArticleBatch articles;          // Unscored candidates
+    vector<Article> rankedArticles; // Or, when ranked, the best ones already scored, best first
+    size_t candidateCount = 0;      // Distinct articles retrieved
+    bool ranked = false;
+};
+
+// Function to ask the local classifier about a question
+// Returns whether it is loaded and confident enough to answer alone; answer is set to its guess either way
+bool classifyLocally(const string& question, const ProgramOptions& options, bool& answer) {
+    QuestionClassifier& classifier = sharedQuestionClassifier();
+    if (!classifier.isLoaded()) {
+        return false;
+    }
+    double probability = classifier.probability(question);
+    answer = probability >= 0.5;
+    return probability >= options.classifierThreshold || probability <= 1.0 - options.classifierThreshold;
+}
+
+// Function to log and count a classification the LLM made, comparing it with a confident local answer
+void recordLLMClassification(const string& question, bool isScientific, bool decided, bool confident, bool localAnswer) {
+    if (decided) {
+        sharedClassificationLog().record(question, isScientific);
+    }
+    updateQueryMetrics([&](QueryMetrics& metrics) {
+        metrics.classifiedByLLM++;
+        if (confident && decided) {
+            (localAnswer == isScientific ? metrics.shadowAgreements : metrics.shadowDisagreements)++;
+        }
+    });
+}
+
+// Function to decide whether a question is scientific, locally when the classifier is confident
+// Otherwise (and always in shadow mode) the LLM decides, and its answer is logged as training data
+bool classifyQuestion(const string& question, const ProgramOptions& options) {
+    bool localAnswer = false;
+    bool confident = classifyLocally(question, options, localAnswer);
+    if (confident && !options.classifierShadow) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.classifiedLocally++; });
+        return localAnswer;
+    }
+    
+    bool decided = false;
+    bool isScientific = isScientificQuestion(question, &decided);
+    recordLLMClassification(question, isScientific, decided, confident, localAnswer);
+    return isScientific;
+}
+
+// Function to classify, extract keywords and validate a question with one structured LLM call
+// A confident local classifier still answers the classification (and "not scientific" needs no call at all).
+// Returns false if the combined answer was unusable; nothing is counted then, so the caller can fall back
+// to the separate calls.
+bool analyzeQuestion(const string& question, const ProgramOptions& options, QueryAnalysis& analysis) {
+    bool localAnswer = false;
+    bool confident = classifyLocally(question, options, localAnswer);
+    bool localOnly = confident && !options.classifierShadow;
+    if (localOnly && !localAnswer) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.classifiedLocally++; });
+        analysis = QueryAnalysis();
+        return true;
+    }
+    
+    if (!analyzeQueryWithGroq(question, analysis) || (localOnly && analysis.keywords.empty())) {
+        return false;
+    }
+    if (localOnly) {
+        updateQueryMetrics([](QueryMetrics& metrics) { metrics.classifiedLocally++; });
+        analysis.isScientific = true;
+    } else {
+        recordLLMClassification(question, analysis.isScientific, true, confident, localAnswer);
+    }
+    return true;
+}
+
+// Function to build the scoring context of a question, with BM25 statistics when that scorer is selected
+QueryContext buildRankingContext(const string& question, const string& keywords, const string& expandedKeywords,
+                                 const ProgramOptions& options, ostream& log) {
+    // Tokenize the question and parse the keyword lists once for all articles
+    QueryContext context = buildQueryContext(question, keywords, expandedKeywords);
+    if (options.scorer == SCORER_BM25 && !attachBM25Statistics(context, question, sharedArticleCorpus())) {
+        log << "Local corpus is empty, using cosine similarity instead of BM25" << endl;
+    }
+    if (options.scorer == SCORER_EMBEDDING) {
+        context.queryEmbedding = computeEmbedding(question);
+        context.scorer = SCORER_EMBEDDING;
+    }
+    return context;
+}
+
+// Function to search Semantic Scholar while scoring every article as it is parsed, keeping the best options.topCount
+// CPU work overlaps the download and memory stays bounded by the page size, however many candidates are fetched
+CandidateSet streamRankedCandidates(const string& question, const string& keywords, const string& expandedKeywords,
+                                    const ProgramOptions& options) {
+    ostream quiet(nullptr);
+    QueryContext context = buildRankingContext(question, keywords, expandedKeywords, options, quiet);
+    int currentYear = currentCalendarYear();
+    TopArticleCollector collector(options.topCount);
+    
+    streamSemanticScholar(expandedKeywords, options.candidateBudget, options.fetchConcurrency, [&](ArticleBatch& batch, size_t row) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        batch.scores[row] = calculateRelevancyScore(batch, row, context, currentYear);
+        chrono::steady_clock::time_point scored = chrono::steady_clock::now();
+        collector.offer(batch, row);
+        chrono::steady_clock::time_point selected = chrono::steady_clock::now();
+        
+        updateQueryMetrics([&](QueryMetrics& metrics) {
+            metrics.timings.score += chrono::duration<double>(scored - start).count();
+            metrics.timings.sort += chrono::duration<double>(selected - scored).count();
+            metrics.articlesScored++;
+        });
+    }, options.recordCorpus ? &sharedArticleCorpus() : nullptr);
+    
+    CandidateSet candidates;
+    candidates.candidateCount = collector.candidateCount();
+    candidates.rankedArticles = collector.takeBest();
+    candidates.ranked = true;
+    return candidates;
+}
+
+// A place candidate articles can be searched for. Every source fills an ArticleBatch, so results from
+// different sources can be merged and scored the same way; adding one means implementing search() here
+// and naming it in makeArticleSource.
+class ArticleSource {
+public:
+    virtual ~ArticleSource() {}
+    
+    // Name used in --sources, warnings and metrics
+    virtual string name() const = 0;
+    
+    // Function to search for up to candidateBudget articles. Runs on its own thread and may be
+    // cancelled (see searchCancelled) once the fan-out deadline has passed.
+    virtual ArticleBatch search(const string& keywords, const string& expandedKeywords, int candidateBudget) = 0;
+};
+
+class SemanticScholarSource : public ArticleSource {
+public:
+    explicit SemanticScholarSource(int maxConcurrency) : maxConcurrency(maxConcurrency) {}
+    
+    string name() const override { return "semanticscholar"; }
+    
+    ArticleBatch search(const string&, const string& expandedKeywords, int candidateBudget) override {
+        return searchSemanticScholar(expandedKeywords, candidateBudget, maxConcurrency);
+    }
+    
+private:
+    int maxConcurrency;
+};
+
+// OpenAlex ranks by relevance to the whole search string, so it gets the plain keywords without the expansion
+class OpenAlexSource : public ArticleSource {
+public:
+    explicit OpenAlexSource(int maxConcurrency) : maxConcurrency(maxConcurrency) {}
+    
+    string name() const override { return "openalex"; }
+    
+    ArticleBatch search(const string& keywords, const string&, int candidateBudget) override {
+        return searchOpenAlex(keywords, candidateBudget, maxConcurrency);
+    }
+    
+private:
+    int maxConcurrency;
+};
+
+class LocalCorpusSource : public ArticleSource {
+public:
+    string name() const override { return "corpus"; }
+    
+    ArticleBatch search(const string&, const string& expandedKeywords, int candidateBudget) override {
+        return sharedArticleCorpus().search(expandedKeywords, candidateBudget);
+    }
+};
+
+// Function to create the source named in --sources, or null for an unknown name
+unique_ptr<ArticleSource> makeArticleSource(const string& name, const ProgramOptions& options) {
+    if (name == "semanticscholar") {
+        return unique_ptr<ArticleSource>(new SemanticScholarSource(options.fetchConcurrency));
+    }
+    if (name == "openalex") {
+        return unique_ptr<ArticleSource>(new OpenAlexSource(options.fetchConcurrency));
+    }
+    if (name == "corpus") {
+        return unique_ptr<ArticleSource>(new LocalCorpusSource());
+    }
+    return nullptr;
+}
+
+// Searches still running in the background: sources the fan-out stopped waiting for, and the speculative
+// searches of pipelined questions that were rejected
+atomic<int> runningSourceSearches(0);
+
+// Function to wait (briefly: they have been cancelled) for abandoned source searches before the program
+// exits, so none of them is left using the HTTP client, cache or corpus while those are destroyed
+void waitForSourceSearches() {
+    while (runningSourceSearches.load() > 0) {
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+// Waits for abandoned source searches when main returns, whichever way it does
+struct SourceSearchGuard {
+    ~SourceSearchGuard() {
+        waitForSourceSearches();
+    }
+};
+
+// Function to add one set of endpoint counters to another
+void addEndpointMetrics(EndpointMetrics& total, const EndpointMetrics& add) {
+    total.requests += add.requests;
+    total.retries += add.retries;
+    total.failures += add.failures;
+    total.cacheHits += add.cacheHits;
+    total.stoppedEarly += add.stoppedEarly;
+    total.bytesReceived += add.bytesReceived;
+    total.bytesSent += add.bytesSent;
+    total.rateLimitWaitSeconds += add.rateLimitWaitSeconds;
+    total.dnsSeconds += add.dnsSeconds;
+    total.connectSeconds += add.connectSeconds;
+    total.tlsSeconds += add.tlsSeconds;
+    total.firstByteSeconds += add.firstByteSeconds;
+    total.totalSeconds += add.totalSeconds;
+}
+
+// Function to add the metrics of work done for a question on its behalf (e.g. by a background search)
+void addQueryMetrics(QueryMetrics& total, const QueryMetrics& add) {
+    StageTimings& timings = total.timings;
+    timings.classify += add.timings.classify;
+    timings.extract += add.timings.extract;
+    timings.validate += add.timings.validate;
+    timings.search += add.timings.search;
+    timings.parse += add.timings.parse;
+    timings.dedup += add.timings.dedup;
+    timings.score += add.timings.score;
+    timings.sort += add.timings.sort;
+    timings.display += add.timings.display;
+    timings.total += add.timings.total;
+    for (const auto& entry : add.endpoints) {
+        addEndpointMetrics(total.endpoints[entry.first], entry.second);
+    }
+    total.articlesParsed += add.articlesParsed;
+    total.duplicatesMerged += add.duplicatesMerged;
+    total.articlesScored += add.articlesScored;
+    total.sourcesDropped += add.sourcesDropped;
+    total.allocations += add.allocations;
+    total.allocatedBytes += add.allocatedBytes;
+    total.classifiedLocally += add.classifiedLocally;
+    total.classifiedByLLM += add.classifiedByLLM;
+    total.shadowAgreements += add.shadowAgreements;
+    total.shadowDisagreements += add.shadowDisagreements;
+}
+
+// Function to hash a title for matching records of one work across sources: lowercase letters and digits only
+uint64_t titleMatchKey(string_view title) {
+    uint64_t hash = 14695981039346656037ULL;
+    bool any = false;
+    for (char c : title) {
+        if (isalnum((unsigned char)c)) {
+            hash ^= (unsigned char)tolower((unsigned char)c);
+            hash *= 1099511628211ULL;
+            any = true;
+        }
+    }
+    return any ? hash : 0;
+}
+
+// State shared between a fan-out and its source threads. It is reference counted because a source that
+// misses the deadline is left running (cancelled) and may finish after the question has been answered.
+struct SourceFanOut {
+    vector<unique_ptr<ArticleSource>> sources;
+    string keywords;
+    string expandedKeywords;
+    int candidateBudget = 0;
+    vector<ArticleBatch> results;    // One per source
+    vector<QueryMetrics> metrics;    // Counters of each source's requests, added to the question's if it is used
+    vector<bool> finished;
+    size_t finishedCount = 0;
+    mutex stateMutex;
+    condition_variable finishedChanged;
+    atomic<bool> cancelled{false};
+};
+
+// Function to search every source at once and merge what comes back within deadlineMs (<= 0: wait for all)
+// A source still running at the deadline is cancelled and dropped, unless nothing has arrived yet, in which
+// case the first source to deliver is waited for. Results are merged in source order: a work already seen
+// (same paperId, or same title from another source) keeps its first record with the higher citation count.
+ArticleBatch searchSources(vector<unique_ptr<ArticleSource>> sources, const string& keywords,
+                           const string& expandedKeywords, int candidateBudget, int deadlineMs) {
+    shared_ptr<SourceFanOut> fanOut = make_shared<SourceFanOut>();
+    size_t sourceCount = sources.size();
+    fanOut->sources = move(sources);
+    fanOut->keywords = keywords;
+    fanOut->expandedKeywords = expandedKeywords;
+    fanOut->candidateBudget = candidateBudget;
+    fanOut->results.resize(sourceCount);
+    fanOut->metrics.resize(sourceCount);
+    fanOut->finished.assign(sourceCount, false);
+    
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(max(0, deadlineMs));
+    for (size_t s = 0; s < sourceCount; s++) {
+        runningSourceSearches++;
+        thread([fanOut, s]() {
+            ArticleBatch found;
+            {
+                QueryMetricsScope scope(&fanOut->metrics[s]);  // Done counting before the metrics are read
+                CancellationScope cancellation(&fanOut->cancelled);
+                found = fanOut->sources[s]->search(fanOut->keywords, fanOut->expandedKeywords, fanOut->candidateBudget);
+            }
+            {
+                lock_guard<mutex> lock(fanOut->stateMutex);
+                fanOut->results[s] = move(found);
+                fanOut->finished[s] = true;
+                fanOut->finishedCount++;
+            }
+            fanOut->finishedChanged.notify_all();
+            runningSourceSearches--;
+        }).detach();
+    }
+    
+    auto anyDelivered = [&]() {
+        for (size_t s = 0; s < sourceCount; s++) {
+            if (fanOut->finished[s] && !fanOut->results[s].empty()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    // Waits in short slices, so that cancelling the search this fan-out is part of also ends the wait
+    unique_lock<mutex> lock(fanOut->stateMutex);
+    while (fanOut->finishedCount < sourceCount && !searchCancelled() &&
+           (deadlineMs <= 0 || chrono::steady_clock::now() < deadline || !anyDelivered())) {
+        chrono::steady_clock::time_point wakeUp = chrono::steady_clock::now() + chrono::milliseconds(50);
+        if (deadlineMs > 0 && deadline > chrono::steady_clock::now()) {
+            wakeUp = min(wakeUp, deadline);
+        }
+        fanOut->finishedChanged.wait_until(lock, wakeUp);
+    }
+    fanOut->cancelled = true;
+    if (searchCancelled()) {
+        return ArticleBatch();  // Whoever started the search no longer wants its results
+    }
+    vector<bool> used = fanOut->finished;  // Results of these are final; the others may still be written
+    lock.unlock();
+    
+    ArticleBatch merged;
+    unordered_map<uint64_t, size_t> rowByPaperId;
+    unordered_map<uint64_t, pair<size_t, size_t>> rowByTitle;  // (row, source it came from)
+    for (size_t s = 0; s < sourceCount; s++) {
+        if (!used[s]) {
+            cerr << "Warning: " << fanOut->sources[s]->name() << " missed the " << deadlineMs
+                 << " ms search deadline, continuing without it" << endl;
+            updateQueryMetrics([](QueryMetrics& metrics) { metrics.sourcesDropped++; });
+            continue;
+        }
+        const QueryMetrics& sourceMetrics = fanOut->metrics[s];
+        updateQueryMetrics([&](QueryMetrics& metrics) { addQueryMetrics(metrics, sourceMetrics); });
+        
+        const ArticleBatch& found = fanOut->results[s];
+        merged.reserve(merged.size() + found.size(), merged.textBytes() + found.textBytes());
+        for (size_t row = 0; row < found.size(); row++) {
+            uint64_t idKey = found.paperId(row).empty() ? 0 : hashTerm(found.paperId(row));
+            uint64_t titleKey = titleMatchKey(found.title(row));
+            auto byId = idKey != 0 ? rowByPaperId.find(idKey) : rowByPaperId.end();
+            auto byTitle = titleKey != 0 ? rowByTitle.find(titleKey) : rowByTitle.end();
+            if (byTitle != rowByTitle.end() && byTitle->second.second == s) {
+                byTitle = rowByTitle.end();  // Repeats within one source are left to mergeNearDuplicates
+            }
+            if (byId != rowByPaperId.end() || byTitle != rowByTitle.end()) {
+                size_t kept = byId != rowByPaperId.end() ? byId->second : byTitle->second.first;
+                merged.citationCounts[kept] = max(merged.citationCounts[kept], found.citationCounts[row]);
+                continue;
+            }
+            if (idKey != 0) {
+                rowByPaperId[idKey] = merged.size();
+            }
+            if (titleKey != 0) {
+                rowByTitle.emplace(titleKey, make_pair(merged.size(), s));
+            }
+            merged.append(found, row);
+        }
+    }
+    return merged;
+}
+
+// Function to retrieve candidate articles from the local corpus and/or the sources in options.sources
+// With options.streamResults, Semantic Scholar results are scored while they download and come back ranked
+CandidateSet retrieveCandidates(const string& question, const string& keywords, const string& expandedKeywords,
+                                const ProgramOptions& options) {
+    CandidateSet candidates;
+    if (options.localFirst || options.offline) {
+        candidates.articles = sharedArticleCorpus().search(expandedKeywords, options.candidateBudget);
+        if (options.offline || candidates.articles.size() >= MIN_LOCAL_RESULTS) {
+            candidates.candidateCount = candidates.articles.size();
+            return candidates;
+        }
+    }
+    
+    if (options.streamResults) {
+        return streamRankedCandidates(question, keywords, expandedKeywords, options);
+    }
+    
+    vector<unique_ptr<ArticleSource>> sources;
+    for (const string& name : options.sources) {
+        sources.push_back(makeArticleSource(name, options));
+    }
+    candidates.articles = searchSources(move(sources), keywords, expandedKeywords, options.candidateBudget, options.deadlineMs);
+    candidates.candidateCount = candidates.articles.size();
+    
+    // Keep everything we fetched for later local queries
+    if (options.recordCorpus) {
+        sharedArticleCorpus().add(candidates.articles);
+    }
+    return candidates;
+}
+
+// Outcome of running a question through the pipeline
+enum QueryStatus {
+    QUERY_OK,
+    QUERY_NOT_SCIENTIFIC,
+    QUERY_INVALID
+};
+
+// Function to run a stage and add its wall-clock time to seconds
+template <typename Stage>
+auto timeStage(double& seconds, Stage&& stage) -> decltype(stage()) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    auto result = stage();
+    seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Structure to hold everything produced for one question
+struct QueryResult {
+    QueryStatus status = QUERY_OK;
+    string keywords;
+    string expandedKeywords;
+    size_t candidateCount = 0;       // Articles retrieved and scored
+    vector<Article> rankedArticles;  // Best articles first
+    QueryMetrics metrics;
+};
+
+// Function to print why a query failed validation
+void printInvalidQueryMessage(ostream& log) {
+    log << "\n[ERROR] The query is invalid for one of the following reasons:" << endl;
+    log << "  - Keywords are unrelated or nonsensical" << endl;
+    log << "  - Query is just a list of keywords, not an actual question or research topic" << endl;
+    log << "  - Concepts are contradictory or don't make sense together" << endl;
+    log << "\nPlease rephrase as a proper scientific question or research statement." << endl;
+}
+
+// Function to name where the search stage looks for articles
+const char* searchSourceName(const ProgramOptions& options) {
+    return options.offline ? "Local Corpus" : options.localFirst ? "Local Corpus, then Semantic Scholar" : "Semantic Scholar";
+}
+
+// Function to run classification, extraction, validation and search one after another
+// Progress is written to log; returns whether the query was accepted
+QueryStatus runSequentialStages(const string& question, const ProgramOptions& options, ostream& log,
+                                string& keywords, string& expandedKeywords, CandidateSet& candidates,
+                                QueryMetrics& metrics) {
+    // Step 1: Determine if it's a scientific question using Groq
+    log << "\n--- Step 1: Classification ---" << endl;
+    log << "Calling Groq API to classify question..." << endl;
+    
+    StageTimings& timings = metrics.timings;
+    bool isScientific = timeStage(timings.classify, [&]() { return classifyQuestion(question, options); });
+    
+    log << "Is this a scientific question? " << (isScientific ? "TRUE" : "FALSE") << endl;
+    
+    if (!isScientific) {
+        log << "\nQuestion is not scientific. Skipping keyword extraction and article search." << endl;
+        return QUERY_NOT_SCIENTIFIC;
+    }
+    
+    // Step 2: Extract keywords
+    log << "\n--- Step 2: Extracting Keywords ---" << endl;
+    log << "Calling Groq API to extract keywords..." << endl;
+    
+    keywords = timeStage(timings.extract, [&]() { return extractKeywordsWithGroq(question); });
+    
+    log << "\nExtracted Keywords: " << keywords << endl;
+    
+    // Validate query and keywords using Groq
+    log << "Validating query..." << endl;
+    string validationResult = timeStage(timings.validate, [&]() { return validateQueryWithGroq(question, keywords); });
+    
+    // Check if query is invalid
+    if (validationResult.find("INVALID") != string::npos) {
+        printInvalidQueryMessage(log);
+        return QUERY_INVALID;
+    }
+    
+    log << "Query validated successfully!" << endl;
+    
+    // Expand keywords to include individual words
+    expandedKeywords = expandKeywords(keywords);
+    log << "Expanded Keywords: " << expandedKeywords << endl;
+    
+    // Step 3: Search Semantic Scholar
+    log << "\n--- Step 3: Searching " << searchSourceName(options) << " ---" << endl;
+    log << "Searching for articles..." << endl;
+    
+    candidates = timeStage(timings.search, [&]() { return retrieveCandidates(question, keywords, expandedKeywords, options); });
+    return QUERY_OK;
+}
+
+// Validation and search started before classification is known. They run detached on state of their own,
+// so a rejected question does not wait for them: they are cancelled and finish in the background.
+struct SpeculativeStages {
+    string question;
+    string keywords;
+    string expandedKeywords;
+    ProgramOptions options;
+    QueryMetrics validationMetrics;   // Added to the question's metrics only if its result is used
+    QueryMetrics searchMetrics;
+    promise<string> validation;
+    promise<CandidateSet> search;
+    atomic<bool> abandoned{false};
+};
+
+// Function to run a speculative stage on a detached thread, with its own metrics and cancelled by abandoned
+template <typename Stage, typename Result>
+void startSpeculativeStage(shared_ptr<SpeculativeStages> stages, QueryMetrics SpeculativeStages::* metrics,
+                           promise<Result> SpeculativeStages::* result, Stage stage) {
+    runningSourceSearches++;
+    thread([stages, metrics, result, stage]() {
+        Result value;
+        {
+            QueryMetricsScope scope(&((*stages).*metrics));  // Done counting before the metrics are read
+            CancellationScope cancellation(&stages->abandoned);
+            value = stage(*stages);
+        }
+        ((*stages).*result).set_value(move(value));
+        runningSourceSearches--;
+    }).detach();
+}
+
+// Function to run the same stages speculatively overlapped:
+// classification and keyword extraction are issued together, and the search starts as soon as
+// keywords exist while validation is still in flight. If classification or validation rejects the
+// query, the speculative stages are cancelled and left to wind down without being waited for.
+// Progress is written to log; returns whether the query was accepted
+QueryStatus runPipelinedStages(const string& question, const ProgramOptions& options, ostream& log,
+                               string& keywords, string& expandedKeywords, CandidateSet& candidates,
+                               QueryMetrics& metrics) {
+    log << "\n--- Steps 1-3: Classification, Keyword Extraction, Validation and Search (pipelined) ---" << endl;
+    log << "Calling Groq API to classify question and extract keywords..." << endl;
+    
+    // These futures join in their destructors, so the stages never outlive the references they capture
+    StageTimings& timings = metrics.timings;
+    future<bool> classification = async(launch::async, [&]() {
+        QueryMetricsScope scope(&metrics);
+        return timeStage(timings.classify, [&]() { return classifyQuestion(question, options); });
+    });
+    future<string> extraction = async(launch::async, [&]() {
+        QueryMetricsScope scope(&metrics);
+        return timeStage(timings.extract, [&]() { return extractKeywordsWithGroq(question); });
+    });
+    
+    keywords = extraction.get();
+    expandedKeywords = expandKeywords(keywords);
+    
+    // Keywords exist: validate and search at the same time
+    shared_ptr<SpeculativeStages> stages = make_shared<SpeculativeStages>();
+    stages->question = question;
+    stages->keywords = keywords;
+    stages->expandedKeywords = expandedKeywords;
+    stages->options = options;
+    future<string> validation = stages->validation.get_future();
+    future<CandidateSet> search = stages->search.get_future();
+    startSpeculativeStage(stages, &SpeculativeStages::validationMetrics, &SpeculativeStages::validation,
+                          [](SpeculativeStages& s) {
+        return timeStage(s.validationMetrics.timings.validate, [&]() { return validateQueryWithGroq(s.question, s.keywords); });
+    });
+    startSpeculativeStage(stages, &SpeculativeStages::searchMetrics, &SpeculativeStages::search,
+                          [](SpeculativeStages& s) {
+        return timeStage(s.searchMetrics.timings.search, [&]() {
+            return retrieveCandidates(s.question, s.keywords, s.expandedKeywords, s.options);
+        });
+    });
+    
+    bool isScientific = classification.get();
+    log << "Is this a scientific question? " << (isScientific ? "TRUE" : "FALSE") << endl;
+    
+    if (!isScientific) {
+        log << "\nQuestion is not scientific. Discarding keyword extraction and article search." << endl;
+        stages->abandoned = true;
+        return QUERY_NOT_SCIENTIFIC;
+    }
+    
+    log << "\nExtracted Keywords: " << keywords << endl;
+    
+    string validationResult = validation.get();
+    {
+        lock_guard<mutex> lock(queryMetricsMutex);
+        addQueryMetrics(metrics, stages->validationMetrics);
+    }
+    if (validationResult.find("INVALID") != string::npos) {
+        printInvalidQueryMessage(log);
+        stages->abandoned = true;
+        return QUERY_INVALID;
+    }
+    
+    log << "Query validated successfully!" << endl;
+    log << "Expanded Keywords: " << expandedKeywords << endl;
+    
+    log << "Waiting for search results..." << endl;
+    candidates = search.get();
+    lock_guard<mutex> lock(queryMetricsMutex);
+    addQueryMetrics(metrics, stages->searchMetrics);
+    return QUERY_OK;
+}
+
+// Function to classify, extract and validate with one structured LLM call, then search
+// Progress is written to log; returns false (with nothing decided) if the combined answer was malformed,
+// in which case the caller runs the separate stages instead
+bool runCombinedStages(const string& question, const ProgramOptions& options, ostream& log,
+                       string& keywords, string& expandedKeywords, CandidateSet& candidates,
+                       QueryMetrics& metrics, QueryStatus& status) {
+    log << "\n--- Steps 1-2: Classification, Keyword Extraction and Validation (combined) ---" << endl;
+    log << "Calling Groq API to classify, extract keywords and validate in one request..." << endl;
+    
+    // The single call is timed as classification; extraction and validation cost nothing extra
+    StageTimings& timings = metrics.timings;
+    QueryAnalysis analysis;
+    if (!timeStage(timings.classify, [&]() { return analyzeQuestion(question, options, analysis); })) {
+        log << "Combined response was malformed, falling back to separate requests." << endl;
+        return false;
+    }
+    
+    log << "Is this a scientific question? " << (analysis.isScientific ? "TRUE" : "FALSE") << endl;
+    
+    if (!analysis.isScientific) {
+        log << "\nQuestion is not scientific. Skipping keyword extraction and article search." << endl;
+        status = QUERY_NOT_SCIENTIFIC;
+        return true;
+    }
+    
+    keywords = analysis.keywords;
+    log << "\nExtracted Keywords: " << keywords << endl;
+    
+    if (!analysis.isValid) {
+        printInvalidQueryMessage(log);
+        status = QUERY_INVALID;
+        return true;
+    }
+    
+    log << "Query validated successfully!" << endl;
+    
+    expandedKeywords = expandKeywords(keywords);
+    log << "Expanded Keywords: " << expandedKeywords << endl;
+    
+    log << "\n--- Step 3: Searching " << searchSourceName(options) << " ---" << endl;
+    log << "Searching for articles..." << endl;
+    
+    candidates = timeStage(timings.search, [&]() { return retrieveCandidates(question, keywords, expandedKeywords, options); });
+    status = QUERY_OK;
+    return true;
+}
+
+// Function to pick the rows with the count best scores, best first
+// Only (score, row) pairs are partitioned and sorted, so the cost is O(n + count log count); equal scores
+// keep their retrieval order
+vector<uint32_t> selectTopRows(const vector<double>& scores, size_t count) {
+    vector<pair<double, uint32_t>> ranking;
+    ranking.reserve(scores.size());
+    for (size_t i = 0; i < scores.size(); i++) {
+        ranking.push_back({scores[i], (uint32_t)i});
+    }
+    
+    auto better = [](const pair<double, uint32_t>& a, const pair<double, uint32_t>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    count = min(count, ranking.size());
+    if (count < ranking.size()) {
+        nth_element(ranking.begin(), ranking.begin() + count, ranking.end(), better);
+    }
+    sort(ranking.begin(), ranking.begin() + count, better);
+    
+    vector<uint32_t> rows;
+    rows.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        rows.push_back(ranking[i].second);
+    }
+    return rows;
+}
+
+// Function to move the count best-scoring articles out of articles, best first
+// Just the winners are moved; the moved-from articles are left empty.
+vector<Article> selectTopArticles(vector<Article>& articles, size_t count) {
+    vector<double> scores;
+    scores.reserve(articles.size());
+    for (const Article& article : articles) {
+        scores.push_back(article.relevancyScore);
+    }
+    
+    vector<Article> topArticles;
+    for (uint32_t row : selectTopRows(scores, count)) {
+        topArticles.push_back(move(articles[row]));
+    }
+    return topArticles;
+}
+
+// Function to score candidate articles and return the best options.topCount of them, best first
+// Near-duplicates are merged first (unless options say otherwise), so each work is scored once and takes
+// one place in the results. Scoring runs over the batch columns; only the winners are copied out as Articles.
+vector<Article> rankArticles(ArticleBatch& articles, const string& question, const string& keywords,
+                             const string& expandedKeywords, const ProgramOptions& options, ostream& log) {
+    chrono::steady_clock::time_point dedupStart = chrono::steady_clock::now();
+    size_t merged = options.mergeDuplicates ? mergeNearDuplicates(articles) : 0;
+    if (merged > 0) {
+        log << "Merged " << merged << " near-duplicate articles" << endl;
+    }
+    double dedupSeconds = chrono::duration<double>(chrono::steady_clock::now() - dedupStart).count();
+    
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int currentYear = currentCalendarYear();
+    QueryContext context = buildRankingContext(question, keywords, expandedKeywords, options, log);
+    
+    // Calculate relevancy scores (the embedding scorer reuses the vectors the corpus has cached)
+    vector<Embedding> embeddings;
+    if (context.scorer == SCORER_EMBEDDING) {
+        sharedArticleCorpus().embeddingsFor(articles, embeddings);
+    }
+    scoreArticleBatch(articles, context, currentYear, &embeddings);
+    double scoreSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    vector<Article> topArticles;
+    for (uint32_t row : selectTopRows(articles.scores, options.topCount)) {
+        topArticles.push_back(articles.toArticle(row));
+    }
+    double sortSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() - scoreSeconds;
+    
+    updateQueryMetrics([&](QueryMetrics& metrics) {
+        metrics.timings.dedup += dedupSeconds;
+        metrics.timings.score += scoreSeconds;
+        metrics.timings.sort += sortSeconds;
+        metrics.duplicatesMerged += merged;
+        metrics.articlesScored += articles.size();
+    });
+    return topArticles;
+}
+
+// Function to run one question through classify -> extract -> validate -> search -> score
+// Progress is written to log (pass a null stream to run silently)
+QueryResult runQuery(const string& question, const ProgramOptions& options, ostream& log) {
+    QueryResult result;
+    CandidateSet candidates;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    {
+        QueryMetricsScope scope(&result.metrics);
+        if (!options.combinedPrompt ||
+            !runCombinedStages(question, options, log, result.keywords, result.expandedKeywords, candidates,
+                               result.metrics, result.status)) {
+            result.status = options.pipeline
+                ? runPipelinedStages(question, options, log, result.keywords, result.expandedKeywords, candidates, result.metrics)
+                : runSequentialStages(question, options, log, result.keywords, result.expandedKeywords, candidates, result.metrics);
+        }
+        
+        if (result.status == QUERY_OK && candidates.candidateCount > 0) {
+            result.candidateCount = candidates.candidateCount;
+            if (candidates.ranked) {
+                // Streamed results were scored while they downloaded
+                result.rankedArticles = move(candidates.rankedArticles);
+            } else {
+                // Step 4: Score and rank articles
+                log << "\n--- Step 4: Scoring and Ranking Articles ---" << endl;
+                log << "Calculating relevancy scores..." << endl;
+                
+                result.rankedArticles = rankArticles(candidates.articles, question, result.keywords, result.expandedKeywords, options, log);
+            }
+        }
+    }
+    
+    result.metrics.timings.total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// Function to list the stage timings of a question by name, in pipeline order
+vector<pair<const char*, double>> stageTimingList(const StageTimings& timings) {
+    return {{"classify", timings.classify}, {"extract", timings.extract}, {"validate", timings.validate},
+            {"search", timings.search}, {"parse", timings.parse}, {"dedup", timings.dedup},
+            {"score", timings.score},
+            {"sort", timings.sort}, {"display", timings.display}, {"total", timings.total}};
+}
+
+// Function to serialize the metrics of one question as a JSON object (times in milliseconds)
+string queryMetricsToJson(const QueryMetrics& metrics) {
+    ostringstream json;
+    json << fixed << setprecision(2);
+    json << "{\"stagesMs\":{";
+    bool first = true;
+    for (const auto& stage : stageTimingList(metrics.timings)) {
+        json << (first ? "" : ",") << "\"" << stage.first << "\":" << stage.second * 1e3;
+        first = false;
+    }
+    json << "},\"endpoints\":{";
+    first = true;
+    for (const auto& entry : metrics.endpoints) {
+        const EndpointMetrics& endpoint = entry.second;
+        json << (first ? "" : ",") << "\"" << escapeJson(entry.first) << "\":{"
+             << "\"requests\":" << endpoint.requests
+             << ",\"retries\":" << endpoint.retries
+             << ",\"failures\":" << endpoint.failures
+             << ",\"cacheHits\":" << endpoint.cacheHits
+             << ",\"stoppedEarly\":" << endpoint.stoppedEarly
+             << ",\"bytesReceived\":" << (uint64_t)endpoint.bytesReceived
+             << ",\"bytesSent\":" << (uint64_t)endpoint.bytesSent
+             << ",\"rateLimitWaitMs\":" << endpoint.rateLimitWaitSeconds * 1e3
+             << ",\"dnsMs\":" << endpoint.dnsSeconds * 1e3
+             << ",\"connectMs\":" << endpoint.connectSeconds * 1e3
+             << ",\"tlsMs\":" << endpoint.tlsSeconds * 1e3
+             << ",\"firstByteMs\":" << endpoint.firstByteSeconds * 1e3
+             << ",\"totalMs\":" << endpoint.totalSeconds * 1e3 << "}";
+        first = false;
+    }
+    json << "},\"articlesParsed\":" << metrics.articlesParsed
+         << ",\"duplicatesMerged\":" << metrics.duplicatesMerged
+         << ",\"articlesScored\":" << metrics.articlesScored
+         << ",\"sourcesDropped\":" << metrics.sourcesDropped;
+    if (ALLOCATIONS_COUNTED) {
+        json << ",\"allocations\":" << metrics.allocations
+             << ",\"allocatedBytes\":" << metrics.allocatedBytes;
+    }
+    json << ",\"classifier\":{\"local\":" << metrics.classifiedLocally
+         << ",\"llm\":" << metrics.classifiedByLLM
+         << ",\"shadowAgreements\":" << metrics.shadowAgreements
+         << ",\"shadowDisagreements\":" << metrics.shadowDisagreements << "}}";
+    return json.str();
+}
+
+// Upper bounds of the stage latency histogram buckets, in seconds
+const vector<double> STAGE_HISTOGRAM_BOUNDS = {0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+
+// Running totals of the metrics of every question answered, exposed in Prometheus text format
+class MetricsRegistry {
+public:
+    // Function to add the metrics of one finished question
+    void record(QueryStatus status, const QueryMetrics& metrics) {
+        lock_guard<mutex> lock(registryMutex);
+        queriesByStatus[status]++;
+        for (const auto& stage : stageTimingList(metrics.timings)) {
+            // Stages a question never reached are left out rather than counted as instant
+            if (stage.second > 0.0) {
+                stageHistograms[stage.first].observe(stage.second);
+            }
+        }
+        for (const auto& entry : metrics.endpoints) {
+            addEndpointMetrics(endpoints[entry.first], entry.second);
+        }
+        articlesParsed += metrics.articlesParsed;
+        duplicatesMerged += metrics.duplicatesMerged;
+        articlesScored += metrics.articlesScored;
+        sourcesDropped += metrics.sourcesDropped;
+        allocations += metrics.allocations;
+        allocatedBytes += metrics.allocatedBytes;
+        classifiedLocally += metrics.classifiedLocally;
+        classifiedByLLM += metrics.classifiedByLLM;
+        shadowAgreements += metrics.shadowAgreements;
+        shadowDisagreements += metrics.shadowDisagreements;
+    }
+    
+    // Function to render every metric in the Prometheus text exposition format
+    string prometheusText() {
+        lock_guard<mutex> lock(registryMutex);
+        ostringstream text;
+        text << setprecision(9);
         
-        if (!keyword.empty()) {
-            // Add the full keyword/phrase first
-            expandedKeywords.push_back(keyword);
+        const char* statusNames[] = {"ok", "not_scientific", "invalid"};
+        text << "# HELP honors_queries_total Questions answered, by outcome.\n"
+             << "# TYPE honors_queries_total counter\n";
+        for (int status = 0; status < 3; status++) {
+            text << "honors_queries_total{status=\"" << statusNames[status] << "\"} " << queriesByStatus[status] << "\n";
+        }
+        
+        text << "# HELP honors_stage_duration_seconds Wall-clock time of each pipeline stage per question.\n"
+             << "# TYPE honors_stage_duration_seconds histogram\n";
+        for (const auto& entry : stageHistograms) {
+            const Histogram& histogram = entry.second;
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < STAGE_HISTOGRAM_BOUNDS.size(); b++) {
+                cumulative += histogram.buckets[b];
+                text << "honors_stage_duration_seconds_bucket{stage=\"" << entry.first << "\",le=\"" << STAGE_HISTOGRAM_BOUNDS[b]
+                     << "\"} " << cumulative << "\n";
+            }
+            text << "honors_stage_duration_seconds_bucket{stage=\"" << entry.first << "\",le=\"+Inf\"} " << histogram.count << "\n"
+                 << "honors_stage_duration_seconds_sum{stage=\"" << entry.first << "\"} " << histogram.sum << "\n"
+                 << "honors_stage_duration_seconds_count{stage=\"" << entry.first << "\"} " << histogram.count << "\n";
+        }
+        
+        writeEndpointCounter(text, "honors_http_requests_total", "HTTP requests sent, retries included.",
+                             [](const EndpointMetrics& e) { return (double)e.requests; });
+        writeEndpointCounter(text, "honors_http_retries_total", "HTTP requests that were retries.",
+                             [](const EndpointMetrics& e) { return (double)e.retries; });
+        writeEndpointCounter(text, "honors_http_failures_total", "API calls that failed after retrying.",
+                             [](const EndpointMetrics& e) { return (double)e.failures; });
+        writeEndpointCounter(text, "honors_cache_hits_total", "API calls answered from the response cache.",
+                             [](const EndpointMetrics& e) { return (double)e.cacheHits; });
+        writeEndpointCounter(text, "honors_http_stopped_early_total", "Streamed responses abandoned once the answer was known.",
+                             [](const EndpointMetrics& e) { return (double)e.stoppedEarly; });
+        writeEndpointCounter(text, "honors_http_received_bytes_total", "Response body bytes received.",
+                             [](const EndpointMetrics& e) { return e.bytesReceived; });
+        writeEndpointCounter(text, "honors_http_sent_bytes_total", "Request bytes sent.",
+                             [](const EndpointMetrics& e) { return e.bytesSent; });
+        writeEndpointCounter(text, "honors_rate_limit_wait_seconds_total", "Time spent waiting for the rate limiter.",
+                             [](const EndpointMetrics& e) { return e.rateLimitWaitSeconds; });
+        
+        text << "# HELP honors_http_phase_seconds_total Time spent in each phase of HTTP requests.\n"
+             << "# TYPE honors_http_phase_seconds_total counter\n";
+        for (const auto& entry : endpoints) {
+            const EndpointMetrics& e = entry.second;
+            pair<const char*, double> phases[] = {{"dns", e.dnsSeconds}, {"connect", e.connectSeconds}, {"tls", e.tlsSeconds},
+                                                  {"first_byte", e.firstByteSeconds}, {"total", e.totalSeconds}};
+            for (const auto& phase : phases) {
+                text << "honors_http_phase_seconds_total{endpoint=\"" << entry.first << "\",phase=\"" << phase.first
+                     << "\"} " << phase.second << "\n";
+            }
+        }
+        
+        text << "# HELP honors_articles_parsed_total Articles parsed from search responses.\n"
+             << "# TYPE honors_articles_parsed_total counter\n"
+             << "honors_articles_parsed_total " << articlesParsed << "\n"
+             << "# HELP honors_duplicates_merged_total Near-duplicate articles merged into another before scoring.\n"
+             << "# TYPE honors_duplicates_merged_total counter\n"
+             << "honors_duplicates_merged_total " << duplicatesMerged << "\n"
+             << "# HELP honors_articles_scored_total Articles given a relevancy score.\n"
+             << "# TYPE honors_articles_scored_total counter\n"
+             << "honors_articles_scored_total " << articlesScored << "\n"
+             << "# HELP honors_sources_dropped_total Article sources left out of a question for missing the search deadline.\n"
+             << "# TYPE honors_sources_dropped_total counter\n"
+             << "honors_sources_dropped_total " << sourcesDropped << "\n";
+        if (ALLOCATIONS_COUNTED) {
+            text << "# HELP honors_allocations_total Heap allocations made while answering questions.\n"
+                 << "# TYPE honors_allocations_total counter\n"
+                 << "honors_allocations_total " << allocations << "\n"
+                 << "# HELP honors_allocated_bytes_total Heap bytes allocated while answering questions.\n"
+                 << "# TYPE honors_allocated_bytes_total counter\n"
+                 << "honors_allocated_bytes_total " << allocatedBytes << "\n";
         }
+        text << "# HELP honors_classifications_total Questions classified, by who decided.\n"
+             << "# TYPE honors_classifications_total counter\n"
+             << "honors_classifications_total{decider=\"local\"} " << classifiedLocally << "\n"
+             << "honors_classifications_total{decider=\"llm\"} " << classifiedByLLM << "\n"
+             << "# HELP honors_classifier_shadow_total Confident local classifications checked against the LLM.\n"
+             << "# TYPE honors_classifier_shadow_total counter\n"
+             << "honors_classifier_shadow_total{result=\"agree\"} " << shadowAgreements << "\n"
+             << "honors_classifier_shadow_total{result=\"disagree\"} " << shadowDisagreements << "\n";
+        return text.str();
     }
     
-    // Now split each phrase into individual words
-    ss.clear();
-    ss.str(keywords);
-    while (getline(ss, keyword, ',')) {
-        // Trim whitespace
-        keyword.erase(0, keyword.find_first_not_of(" \t\n\r"));
-        keyword.erase(keyword.find_last_not_of(" \t\n\r") + 1);
+private:
+    struct Histogram {
+        vector<uint64_t> buckets;  // Observations per bucket (not cumulative)
+        double sum = 0.0;
+        uint64_t count = 0;
         
-        if (!keyword.empty()) {
-            // Split multi-word phrases into individual words
-            istringstream wordStream(keyword);
-            string word;
-            while (wordStream >> word) {
-                // Remove punctuation from word
-                word.erase(remove_if(word.begin(), word.end(), 
-                    [](char c) { return !isalnum(c) && c != '-'; }), word.end());
-                
-                // Only add if it's not already in the list and not too short
-                if (word.length() > 2 && 
-                    find(expandedKeywords.begin(), expandedKeywords.end(), word) == expandedKeywords.end()) {
-                    expandedKeywords.push_back(word);
-                }
+        void observe(double seconds) {
+            buckets.resize(STAGE_HISTOGRAM_BOUNDS.size());
+            size_t b = lower_bound(STAGE_HISTOGRAM_BOUNDS.begin(), STAGE_HISTOGRAM_BOUNDS.end(), seconds) - STAGE_HISTOGRAM_BOUNDS.begin();
+            if (b < buckets.size()) {
+                buckets[b]++;
             }
+            sum += seconds;
+            count++;
         }
-    }
+    };
     
-    // Join back into comma-separated string
-    string result;
-    for (size_t i = 0; i < expandedKeywords.size(); i++) {
-        result += expandedKeywords[i];
-        if (i < expandedKeywords.size() - 1) {
-            result += ", ";
+    mutex registryMutex;
+    size_t queriesByStatus[3] = {0, 0, 0};
+    map<string, Histogram> stageHistograms;
+    map<string, EndpointMetrics> endpoints;
+    uint64_t articlesParsed = 0;
+    uint64_t duplicatesMerged = 0;
+    uint64_t articlesScored = 0;
+    uint64_t sourcesDropped = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t classifiedLocally = 0;
+    uint64_t classifiedByLLM = 0;
+    uint64_t shadowAgreements = 0;
+    uint64_t shadowDisagreements = 0;
+    
+    void writeEndpointCounter(ostringstream& text, const char* name, const char* help,
+                              const function<double(const EndpointMetrics&)>& value) {
+        text << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+        for (const auto& entry : endpoints) {
+            text << name << "{endpoint=\"" << entry.first << "\"} " << value(entry.second) << "\n";
         }
     }
+};
+
+// Function to get the registry the server reports on GET /metrics
+MetricsRegistry& sharedMetricsRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+// Function to serialize a query result as one line of JSON, with its metrics if includeMetrics is set
+// The time spent writing out the articles is recorded as the result's display stage
+string queryResultToJson(size_t index, const string& question, QueryResult& result, bool includeMetrics) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    const char* statusNames[] = {"ok", "not_scientific", "invalid"};
+    ostringstream json;
+    json << fixed << setprecision(2);
+    json << "{\"index\":" << index
+         << ",\"question\":\"" << escapeJson(question) << "\""
+         << ",\"status\":\"" << statusNames[result.status] << "\""
+         << ",\"keywords\":\"" << escapeJson(result.keywords) << "\""
+         << ",\"expandedKeywords\":\"" << escapeJson(result.expandedKeywords) << "\""
+         << ",\"candidates\":" << result.candidateCount
+         << ",\"articles\":[";
+    for (size_t i = 0; i < result.rankedArticles.size(); i++) {
+        const Article& article = result.rankedArticles[i];
+        json << (i > 0 ? "," : "")
+             << "{\"rank\":" << (i + 1)
+             << ",\"score\":" << article.relevancyScore
+             << ",\"paperId\":\"" << escapeJson(article.paperId) << "\""
+             << ",\"title\":\"" << escapeJson(article.title) << "\""
+             << ",\"year\":" << article.year
+             << ",\"citationCount\":" << article.citationCount
+             << ",\"url\":\"" << escapeJson(article.url) << "\""
+             << ",\"abstract\":\"" << escapeJson(article.abstract) << "\"}";
+    }
+    json << "]";
     
-    return result;
+    result.metrics.timings.display = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (includeMetrics) {
+        json << ",\"metrics\":" << queryMetricsToJson(result.metrics);
+    }
+    json << "}";
+    return json.str();
 }
 
-// Function to extract keywords using Groq
-string extractKeywordsWithGroq(const string& question) {
-    string prompt = "You are an expert in scientific research and natural language processing.\n"
-                   "Your task is to extract the most important scientific and technical keywords or keyphrases\n"
-                   "from a user's research question.\n\n"
-                   "Focus on nouns, noun phrases, and technical terms that represent the core subjects of the query.\n"
-                   "Ignore common stop words (e.g., 'the', 'is', 'a'), interrogative words (e.g., 'what', 'how'),\n"
-                   "and vague verbs (e.g., 'affect', 'impact').\n\n"
-                   "Return the keywords as a single, comma-separated string. Do not add any other explanation.\n\n"
-                   "-- EXAMPLES --\n"
-                   "Query: What is the effect of caffeine on human sleep cycles?\n"
-                   "Keywords: caffeine, human sleep cycles\n\n"
-                   "Query: The use of CRISPR-Cas9 for gene editing in treating genetic disorders.\n"
-                   "Keywords: CRISPR-Cas9, gene editing, genetic disorders\n\n"
-                   "Query: How do photovoltaic cells convert sunlight into electricity?\n"
-                   "Keywords: photovoltaic cells, sunlight, electricity\n"
-                   "-- END EXAMPLES --\n\n"
-                   "Now, extract the keywords from the following query.\n\n"
-                   "Query: " + question + "\n"
-                   "Keywords:";
+// Function to answer every question of a file (one per line, "-" for stdin) and print one JSON line each
+// Up to options.batchConcurrency questions run at once; all of them share the HTTP client, caches and
+// rate limiters, so the API quotas hold for the whole batch. Lines are printed as questions finish.
+int runBatch(const ProgramOptions& options) {
+    ifstream file;
+    if (options.batchInput != "-") {
+        file.open(options.batchInput);
+        if (!file) {
+            cerr << "Could not open " << options.batchInput << endl;
+            return 1;
+        }
+    }
+    istream& input = options.batchInput == "-" ? cin : file;
+    
+    mutex inputMutex;
+    mutex outputMutex;
+    size_t nextIndex = 0;
+    ostream quiet(nullptr);
+    QueryMetrics classifierTotals;
+    
+    // Each worker reads its next question only when it is free, so input can be streamed
+    runConcurrently(options.batchConcurrency, options.batchConcurrency, [&](size_t) {
+        while (true) {
+            string question;
+            size_t index;
+            {
+                lock_guard<mutex> lock(inputMutex);
+                do {
+                    if (!getline(input, question)) {
+                        return;
+                    }
+                    question.erase(0, question.find_first_not_of(" \t\r"));
+                    question.erase(question.find_last_not_of(" \t\r") + 1);
+                } while (question.empty());
+                index = nextIndex++;
+            }
+            
+            QueryResult result = runQuery(question, options, quiet);
+            string line = queryResultToJson(index, question, result, options.emitMetrics);
+            
+            lock_guard<mutex> lock(outputMutex);
+            cout << line << endl;
+            classifierTotals.classifiedLocally += result.metrics.classifiedLocally;
+            classifierTotals.classifiedByLLM += result.metrics.classifiedByLLM;
+            classifierTotals.shadowAgreements += result.metrics.shadowAgreements;
+            classifierTotals.shadowDisagreements += result.metrics.shadowDisagreements;
+        }
+    });
     
-    return callGroqAPI(prompt);
+    if (sharedQuestionClassifier().isLoaded()) {
+        cerr << "Classifier: " << classifierTotals.classifiedLocally << " questions decided locally, "
+             << classifierTotals.classifiedByLLM << " by the LLM";
+        size_t compared = classifierTotals.shadowAgreements + classifierTotals.shadowDisagreements;
+        if (compared > 0) {
+            cerr << "; the LLM agreed with " << classifierTotals.shadowAgreements << " of " << compared
+                 << " confident local answers";
+        }
+        cerr << endl;
+    }
+    return 0;
 }
 
-// Function to parse Semantic Scholar results into Article structs
-vector<Article> parseSemanticScholarResults(const string& jsonResponse) {
-    vector<Article> articles;
+// Structure to hold one recorded API response served by the stand-in server
+struct RecordedResponse {
+    long status = 200;
+    string body;
+};
+
+// Function to load a recording made with --record, keyed like the requests the stand-in server will see
+// Later lines win, so re-recording a question replaces its old responses
+bool loadRecordedResponses(const string& path, unordered_map<uint64_t, RecordedResponse>& responses) {
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
     
-    size_t dataPos = jsonResponse.find("\"data\"");
-    if (dataPos == string::npos) {
-        return articles;
+    string line;
+    size_t lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        unordered_map<string, string> fields;
+        if (line.empty() || !parseJsonFields(line, fields) || fields["endpoint"].empty()) {
+            cerr << "Warning: skipping malformed line " << lineNumber << " of " << path << endl;
+            continue;
+        }
+        RecordedResponse response;
+        response.status = parseJsonInt(fields["status"], 200);
+        response.body = move(fields["body"]);
+        responses[makeCacheKey(fields["endpoint"], fields["request"])] = move(response);
+    }
+    return true;
+}
+
+// Function to run a stand-in for the Groq and Semantic Scholar APIs that replays a recording
+// POST requests are matched as Groq calls by body, GET requests as Semantic Scholar searches by query string.
+// Every answer is delayed by latency +/- jitter milliseconds, and a share of requests (rate429) get 429.
+int runReplayServer(const ProgramOptions& options) {
+    unordered_map<uint64_t, RecordedResponse> responses;
+    if (!loadRecordedResponses(options.replayInput, responses)) {
+        cerr << "Could not open " << options.replayInput << endl;
+        return 1;
     }
     
-    size_t pos = dataPos;
+    atomic<size_t> served(0), misses(0), throttled(0);
     
-    while (pos != string::npos && articles.size() < 45) {
-        pos = jsonResponse.find("\"paperId\"", pos + 1);
-        if (pos == string::npos) break;
+    HttpServer server([&](const HttpServerRequest& request) {
+        thread_local mt19937 random(random_device{}());
+        uniform_real_distribution<double> chance(0.0, 1.0);
         
-        Article article;
-        article.year = 0;
-        article.citationCount = 0;
-        article.relevancyScore = 0.0;
-        
-        // Extract title
-        size_t titlePos = jsonResponse.find("\"title\"", pos);
-        if (titlePos != string::npos) {
-            size_t titleStart = jsonResponse.find("\"", titlePos + 7);
-            size_t titleEnd = jsonResponse.find("\"", titleStart + 1);
-            if (titleStart != string::npos && titleEnd != string::npos) {
-                article.title = jsonResponse.substr(titleStart + 1, titleEnd - titleStart - 1);
-            }
-        }
-        
-        // Extract year
-        size_t yearPos = jsonResponse.find("\"year\"", pos);
-        if (yearPos != string::npos && yearPos < jsonResponse.find("\"paperId\"", pos + 1)) {
-            size_t yearStart = jsonResponse.find(":", yearPos);
-            size_t yearEnd = jsonResponse.find_first_of(",}", yearStart);
-            if (yearStart != string::npos && yearEnd != string::npos) {
-                string yearStr = jsonResponse.substr(yearStart + 1, yearEnd - yearStart - 1);
-                yearStr.erase(remove_if(yearStr.begin(), yearStr.end(), 
-                    [](char c) { return isspace(c) || c == '\0'; }), yearStr.end());
-                if (yearStr != "null" && !yearStr.empty()) {
-                    article.year = stoi(yearStr);
-                }
-            }
+        double delayMs = options.replayLatencyMs + (chance(random) * 2.0 - 1.0) * options.replayJitterMs;
+        this_thread::sleep_for(chrono::duration<double, milli>(max(0.0, delayMs)));
+        
+        HttpServerResponse response;
+        if (chance(random) < options.replay429Rate) {
+            throttled++;
+            response.status = 429;
+            response.headers.push_back({"Retry-After", "1"});
+            response.body = "{\"error\":\"rate limit injected by stand-in server\"}";
+            return response;
         }
         
-        // Extract citation count
-        size_t citationPos = jsonResponse.find("\"citationCount\"", pos);
-        if (citationPos != string::npos && citationPos < jsonResponse.find("\"paperId\"", pos + 1)) {
-            size_t citationStart = jsonResponse.find(":", citationPos);
-            size_t citationEnd = jsonResponse.find_first_of(",}", citationStart);
-            if (citationStart != string::npos && citationEnd != string::npos) {
-                string citationsStr = jsonResponse.substr(citationStart + 1, citationEnd - citationStart - 1);
-                citationsStr.erase(remove_if(citationsStr.begin(), citationsStr.end(), 
-                    [](char c) { return isspace(c) || c == '\0'; }), citationsStr.end());
-                if (citationsStr != "null" && !citationsStr.empty()) {
-                    article.citationCount = stoi(citationsStr);
-                }
-            }
+        bool isGroq = request.method == "POST";
+        size_t queryStart = request.target.find('?');
+        string key = isGroq ? request.body : queryStart == string::npos ? "" : request.target.substr(queryStart + 1);
+        auto found = responses.find(makeCacheKey(isGroq ? "groq" : "semanticscholar", key));
+        if (!isGroq && found == responses.end()) {
+            found = responses.find(makeCacheKey("openalex", key));  // Both search APIs are GETs
+        }
+        if (found == responses.end()) {
+            misses++;
+            cerr << "[replay] no recorded response for " << request.method << " " << request.target << endl;
+            response.status = 404;
+            response.body = "{\"error\":\"no recorded response for this request\"}";
+            return response;
         }
         
-        // Extract abstract
-        size_t abstractPos = jsonResponse.find("\"abstract\"", pos);
-        if (abstractPos != string::npos && abstractPos < jsonResponse.find("\"paperId\"", pos + 1)) {
-            size_t abstractStart = jsonResponse.find("\"", abstractPos + 10);
-            size_t abstractEnd = jsonResponse.find("\"", abstractStart + 1);
-            if (abstractStart != string::npos && abstractEnd != string::npos) {
-                article.abstract = jsonResponse.substr(abstractStart + 1, abstractEnd - abstractStart - 1);
-                if (article.abstract == "null") {
-                    article.abstract = "";
-                }
-            }
+        served++;
+        response.status = (int)found->second.status;
+        response.body = found->second.body;
+        return response;
+    }, options.serverWorkers, options.serverQueueSize);
+    
+    if (!server.listen("127.0.0.1", options.servePort)) {
+        cerr << "Could not listen on 127.0.0.1:" << options.servePort << endl;
+        return 1;
+    }
+    installServerStopHandler();
+    cerr << "Replaying " << responses.size() << " recorded responses on http://127.0.0.1:" << server.port()
+         << " (use --groq-url and --semantic-scholar-url with this address)" << endl;
+    server.run();
+    cerr << "Replay server stopped: " << served << " served, " << misses << " unmatched, " << throttled << " throttled" << endl;
+    return 0;
+}
+
+// Function to run the long-lived server mode: POST /query answers a question, GET /health reports liveness
+// Every request shares the same warm HTTP connections, caches, corpus and rate limiters
+int runServer(const ProgramOptions& options) {
+    atomic<size_t> requestCount(0);
+    
+    HttpServer server([&](const HttpServerRequest& request) {
+        HttpServerResponse response;
+        if (request.path == "/health") {
+            response.body = "{\"status\":\"ok\"}";
+            return response;
+        }
+        if (request.path == "/metrics") {
+            response.contentType = "text/plain; version=0.0.4";
+            response.body = sharedMetricsRegistry().prometheusText();
+            return response;
+        }
+        if (request.path != "/query") {
+            response.status = 404;
+            response.body = "{\"error\":\"unknown path, use POST /query\"}";
+            return response;
+        }
+        if (request.method != "POST") {
+            response.status = 405;
+            response.body = "{\"error\":\"use POST\"}";
+            return response;
         }
         
-        // Extract URL
-        size_t urlPos = jsonResponse.find("\"url\"", pos);
-        if (urlPos != string::npos && urlPos < jsonResponse.find("\"paperId\"", pos + 1)) {
-            size_t urlStart = jsonResponse.find("\"", urlPos + 5);
-            size_t urlEnd = jsonResponse.find("\"", urlStart + 1);
-            if (urlStart != string::npos && urlEnd != string::npos) {
-                article.url = jsonResponse.substr(urlStart + 1, urlEnd - urlStart - 1);
-            }
+        unordered_map<string, string> fields;
+        if (!parseJsonFields(request.body, fields) || fields["question"].empty()) {
+            response.status = 400;
+            response.body = "{\"error\":\"body must be a JSON object with a non-empty \\\"question\\\" string\"}";
+            return response;
         }
         
-        articles.push_back(article);
+        const string& question = fields["question"];
+        size_t index = requestCount++;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        ostream quiet(nullptr);
+        QueryResult result = runQuery(question, options, quiet);
+        response.body = queryResultToJson(index, question, result, options.emitMetrics);
+        sharedMetricsRegistry().record(result.status, result.metrics);
+        
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cerr << "[server] query " << index << " answered in " << fixed << setprecision(2) << seconds << "s" << endl;
+        return response;
+    }, options.serverWorkers, options.serverQueueSize);
+    
+    if (!server.listen("127.0.0.1", options.servePort)) {
+        cerr << "Could not listen on 127.0.0.1:" << options.servePort << endl;
+        return 1;
     }
+    installServerStopHandler();
+    cerr << "Listening on http://127.0.0.1:" << server.port() << " (POST /query, GET /health)" << endl;
+    server.run();
+    cerr << "Server stopped" << endl;
+    return 0;
+}
+
+// Words used to build synthetic titles and abstracts (biomedical vocabulary plus common filler)
+const vector<string> BENCHMARK_VOCABULARY = {
+    "the", "of", "and", "in", "to", "a", "with", "for", "we", "was", "were", "is", "by", "that", "on", "as",
+    "this", "from", "these", "results", "study", "patients", "analysis", "data", "associated", "significant",
+    "increased", "reduced", "effect", "effects", "model", "clinical", "cells", "expression", "gut", "microbiome",
+    "immune", "response", "autoimmune", "disease", "inflammation", "bacterial", "composition", "diversity",
+    "cohort", "mice", "intestinal", "barrier", "cytokine", "regulatory", "t-cell", "antibody", "metabolite",
+    "short-chain", "fatty", "acids", "probiotic", "treatment", "randomized", "trial", "risk", "factors",
+    "genetic", "signaling", "pathway", "protein", "receptor", "tissue", "samples", "sequencing", "16S", "rRNA",
+    "observed", "compared", "control", "group", "levels", "higher", "lower", "mechanism", "role", "novel",
+    "evidence", "suggest", "however", "further", "potential", "therapeutic", "target", "outcomes", "years"
+};
+
+// Function to generate a Semantic Scholar search response with count synthetic papers
+// Abstract lengths follow a rough normal distribution around 200 words; about 10% of papers have none
+string generateBenchmarkPayload(size_t count, uint64_t seed) {
+    mt19937_64 random(seed);
+    normal_distribution<double> abstractWords(200.0, 60.0);
+    uniform_int_distribution<size_t> word(0, BENCHMARK_VOCABULARY.size() - 1);
+    uniform_int_distribution<int> titleWords(6, 16);
+    uniform_int_distribution<int> year(1995, 2025);
+    lognormal_distribution<double> citations(2.5, 1.5);
+    uniform_real_distribution<double> chance(0.0, 1.0);
     
-    return articles;
+    string json = "{\"total\": " + to_string(count) + ", \"offset\": 0, \"data\": [";
+    for (size_t i = 0; i < count; i++) {
+        char paperId[41];
+        snprintf(paperId, sizeof(paperId), "%016llx%016llx%08x", (unsigned long long)random(),
+                 (unsigned long long)random(), (unsigned)i);
+        
+        if (i > 0) json += ", ";
+        json += "{\"paperId\": \"";
+        json += paperId;
+        json += "\", \"url\": \"https://www.semanticscholar.org/paper/";
+        json += paperId;
+        json += "\", \"title\": \"";
+        int titleLength = titleWords(random);
+        for (int w = 0; w < titleLength; w++) {
+            if (w > 0) json += ' ';
+            json += BENCHMARK_VOCABULARY[word(random)];
+        }
+        json += "\", \"year\": " + to_string(year(random));
+        json += ", \"citationCount\": " + to_string((long long)citations(random));
+        
+        if (chance(random) < 0.1) {
+            json += ", \"abstract\": null}";
+            continue;
+        }
+        json += ", \"abstract\": \"";
+        int abstractLength = max(20, (int)abstractWords(random));
+        for (int w = 0; w < abstractLength; w++) {
+            if (w > 0) json += (w % 18 == 0) ? ". " : " ";
+            // Escapes show up in real abstracts (quotes, accented names), so keep a few in the payload
+            double roll = chance(random);
+            if (roll < 0.005) json += "\\\"";
+            else if (roll < 0.008) json += "na\\u00efve ";
+            json += BENCHMARK_VOCABULARY[word(random)];
+        }
+        json += ".\"}";
+    }
+    json += "]}";
+    return json;
 }
 
-// Function to search Semantic Scholar and return articles
-vector<Article> searchSemanticScholar(const string& keywords) {
-    CURL* curl;
-    CURLcode res;
-    string responseString;
-    vector<Article> articles;
+// Timings and allocation counts collected for one benchmarked stage
+struct BenchmarkStage {
+    string name;
+    vector<double> latencies;  // Seconds per call
+    double seconds = 0.0;
+    uint64_t articles = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
     
-    time_t now = time(0);
-    tm* ltm = localtime(&now);
-    int currentYear = 1900 + ltm->tm_year;
-    int startYear = currentYear - 25;
+    explicit BenchmarkStage(const string& name) : name(name) {}
     
-    string query = urlEncode(keywords);
-    string url = SEMANTIC_SCHOLAR_API_URL + "?query=" + query + 
-                 "&year=" + to_string(startYear) + "-" + to_string(currentYear) +
-                 "&limit=45" +
-                 "&fields=title,year,abstract,citationCount,url";
+    // Function to time one call covering the given number of articles and input bytes
+    template <typename Call>
+    void measure(size_t articleCount, size_t byteCount, Call&& call) {
+        uint64_t allocationsBefore = threadAllocationCount;
+        uint64_t bytesBefore = threadAllocatedBytes;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        call();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        allocations += threadAllocationCount - allocationsBefore;
+        allocatedBytes += threadAllocatedBytes - bytesBefore;
+        latencies.push_back(elapsed);
+        seconds += elapsed;
+        articles += articleCount;
+        bytes += byteCount;
+    }
+};
+
+// Function to get the p-th percentile (0-1) of a sorted list of latencies
+double latencyPercentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[index];
+}
+
+// Function to print one result row of the benchmark table
+void printBenchmarkStage(BenchmarkStage& stage) {
+    sort(stage.latencies.begin(), stage.latencies.end());
+    double articlesPerSecond = stage.seconds > 0 ? stage.articles / stage.seconds : 0.0;
+    double megabytesPerSecond = stage.seconds > 0 ? stage.bytes / stage.seconds / (1 << 20) : 0.0;
+    double allocationsPerArticle = stage.articles > 0 ? (double)stage.allocations / stage.articles : 0.0;
     
-    curl = curl_easy_init();
-    if (curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseString);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "ScientificResearchApp/1.0");
+    cout << "  " << left << setw(28) << stage.name << right << fixed
+         << setw(10) << setprecision(0) << stage.latencies.size()
+         << setw(14) << setprecision(0) << articlesPerSecond
+         << setw(10) << setprecision(1) << megabytesPerSecond;
+    if (ALLOCATIONS_COUNTED) {
+        cout << setw(11) << setprecision(1) << allocationsPerArticle;
+    } else {
+        cout << setw(11) << "n/a";
+    }
+    cout << setw(11) << setprecision(2) << latencyPercentile(stage.latencies, 0.50) * 1e6
+         << setw(11) << setprecision(2) << latencyPercentile(stage.latencies, 0.95) * 1e6
+         << setw(11) << setprecision(2) << latencyPercentile(stage.latencies, 0.99) * 1e6 << endl;
+}
+
+// Function to benchmark the parse / tokenize / score / sort hot paths on synthetic payloads
+// Nothing touches the network, the cache or the corpus, so runs are repeatable
+int runBenchmark(const ProgramOptions& options) {
+    const string question = "How does gut microbiome composition affect the immune response in autoimmune disease?";
+    const string keywords = "gut microbiome, immune response, autoimmune disease";
+    const string expandedKeywords = "microbiome, immune, autoimmune, inflammation, cytokine, intestinal barrier";
+    const int currentYear = 2025;
+    
+    QueryContext context = buildQueryContext(question, keywords, expandedKeywords);
+    double sink = 0.0;  // Keeps the compiler from discarding results
+    
+    for (int size : options.benchmarkSizes) {
+        string payload = generateBenchmarkPayload(size, 0x5eed + size);
         
-        res = curl_easy_perform(curl);
+        BenchmarkStage parseStage{"parseSemanticScholarResults"};
+        BenchmarkStage tokenizeStage{"tokenizeInto"};
+        BenchmarkStage scalarTokenizeStage{"tokenizeScalar"};
+        BenchmarkStage tfStage{"calculateTF"};
+        BenchmarkStage cosineStage{"calculateCosineSimilarity"};
+        BenchmarkStage keywordStage{"calculateKeywordMatchScore"};
+        BenchmarkStage relevancyStage{"calculateRelevancyScore"};
+        BenchmarkStage sortStage{"selectTopArticles (top 15)"};
+        BenchmarkStage batchParseStage{"parseSemanticScholarBatch"};
+        BenchmarkStage dedupStage{"mergeNearDuplicates"};
+        BenchmarkStage batchScoreStage{"scoreArticleBatch"};
+        BenchmarkStage batchSortStage{"selectTopRows (top 15)"};
+        BenchmarkStage embedStage{"computeEmbedding"};
+        BenchmarkStage similarityStage{"embeddingSimilarity (cached)"};
         
-        if (res != CURLE_OK) {
-            cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << endl;
-            curl_easy_cleanup(curl);
-            return articles;
+        vector<Article> articles;
+        ArticleBatch batch;
+        TokenBuffer tokens;
+        TokenBuffer scalarTokens;
+        vector<uint64_t> hashes;
+        vector<Embedding> embeddings;
+        Embedding queryEmbedding = computeEmbedding(question);
+        size_t tokenMismatches = 0;
+        size_t abstractBytes = 0;
+        for (int iteration = 0; iteration < options.benchmarkIterations; iteration++) {
+            parseStage.measure(size, payload.size(), [&]() {
+                articles = parseSemanticScholarResults(payload, size);
+            });
+            
+            abstractBytes = 0;
+            for (const Article& article : articles) {
+                abstractBytes += article.abstract.size();
+                tokenizeStage.measure(1, article.abstract.size(), [&]() {
+                    tokenizeInto(article.abstract, tokens);
+                });
+                scalarTokenizeStage.measure(1, article.abstract.size(), [&]() {
+                    tokenizeScalar(article.abstract, scalarTokens);
+                });
+                tokenMismatches += tokens.tokens != scalarTokens.tokens;
+                
+                tokenHashes(article.abstract, hashes);
+                tfStage.measure(1, article.abstract.size(), [&]() {
+                    sink += calculateTF(hashes).norm;
+                });
+                cosineStage.measure(1, article.abstract.size(), [&]() {
+                    sink += calculateCosineSimilarity(context, article.abstract);
+                });
+                keywordStage.measure(1, article.abstract.size(), [&]() {
+                    sink += calculateKeywordMatchScore(article, context);
+                });
+            }
+            for (Article& article : articles) {
+                relevancyStage.measure(1, article.abstract.size(), [&]() {
+                    article.relevancyScore = calculateRelevancyScore(article, context, currentYear);
+                });
+            }
+            
+            vector<Article> scored = articles;
+            sortStage.measure(scored.size(), 0, [&]() {
+                sink += selectTopArticles(scored, 15).size();
+            });
+            
+            // The same work on the columnar batch; clearing keeps its capacity, as a long-lived batch would
+            batch.clear();
+            batchParseStage.measure(size, payload.size(), [&]() {
+                parseSemanticScholarBatch(payload, size, batch);
+            });
+            ArticleBatch deduplicated = batch;
+            dedupStage.measure(deduplicated.size(), deduplicated.textBytes(), [&]() {
+                sink += mergeNearDuplicates(deduplicated);
+            });
+            batchScoreStage.measure(batch.size(), batch.textBytes(), [&]() {
+                scoreArticleBatch(batch, context, currentYear);
+            });
+            batchSortStage.measure(batch.size(), 0, [&]() {
+                sink += selectTopRows(batch.scores, 15).size();
+            });
+            
+            // Embedding a batch happens once per article (when it enters the corpus); comparing against the
+            // cached vectors is what every query pays
+            embedStage.measure(batch.size(), batch.textBytes(), [&]() {
+                embeddings.resize(batch.size());
+                for (size_t row = 0; row < batch.size(); row++) {
+                    embeddings[row] = computeEmbedding(batch.abstract(row));
+                }
+            });
+            similarityStage.measure(embeddings.size(), embeddings.size() * sizeof(Embedding), [&]() {
+                for (const Embedding& embedding : embeddings) {
+                    sink += embeddingSimilarity(queryEmbedding, embedding);
+                }
+            });
         }
         
-        curl_easy_cleanup(curl);
-        
-        articles = parseSemanticScholarResults(responseString);
+        cout << "\n" << size << " papers: " << fixed << setprecision(2) << payload.size() / 1048576.0 << " MB of JSON, "
+             << articles.size() << " parsed, " << abstractBytes / max((size_t)1, articles.size()) << " bytes per abstract on average, "
+             << options.benchmarkIterations << " iterations" << endl;
+        cout << "  " << left << setw(28) << "stage" << right << setw(10) << "calls" << setw(14) << "articles/s"
+             << setw(10) << "MB/s" << setw(11) << "allocs/art" << setw(11) << "p50 us" << setw(11) << "p95 us"
+             << setw(11) << "p99 us" << endl;
+        for (BenchmarkStage* stage : {&parseStage, &tokenizeStage, &scalarTokenizeStage, &tfStage, &cosineStage, &keywordStage,
+                                      &relevancyStage, &sortStage, &batchParseStage, &dedupStage, &batchScoreStage,
+                                      &batchSortStage, &embedStage, &similarityStage}) {
+            printBenchmarkStage(*stage);
+        }
+        if (tokenMismatches > 0) {
+            cout << "  WARNING: tokenizeInto and tokenizeScalar disagreed on " << tokenMismatches << " abstracts" << endl;
+        }
     }
     
-    return articles;
+    cerr << "(checksum " << sink << ")" << endl;
+    return 0;
 }
 
-// Function to display articles with relevancy scores
-void displayRankedArticles(const vector<Article>& articles) {
-    if (articles.empty()) {
-        cout << "\nNo articles found for the given keywords." << endl;
-        return;
+// Function to print the latency percentiles of one stage of a load run, in milliseconds
+void printLoadStage(const string& name, vector<double> seconds) {
+    sort(seconds.begin(), seconds.end());
+    cout << "  " << left << setw(14) << name << right << fixed << setprecision(1)
+         << setw(10) << latencyPercentile(seconds, 0.50) * 1e3
+         << setw(10) << latencyPercentile(seconds, 0.95) * 1e3
+         << setw(10) << latencyPercentile(seconds, 0.99) * 1e3
+         << setw(10) << (seconds.empty() ? 0.0 : seconds.back() * 1e3) << endl;
+}
+
+// Function to drive the pipeline with a fixed arrival rate of questions and report latency percentiles
+// Arrivals are scheduled up front (open loop), and end-to-end latency counts from the scheduled time, so
+// time spent waiting for a free worker shows up in the numbers instead of silently lowering the load
+int runLoad(const ProgramOptions& options) {
+    ifstream file(options.loadInput);
+    if (!file) {
+        cerr << "Could not open " << options.loadInput << endl;
+        return 1;
+    }
+    vector<string> questions;
+    string line;
+    while (getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty()) {
+            questions.push_back(line);
+        }
+    }
+    if (questions.empty()) {
+        cerr << options.loadInput << " has no questions" << endl;
+        return 1;
     }
     
-    for (size_t i = 0; i < articles.size(); i++) {
-        cout << "\n=== Article " << (i + 1) << " ===" << endl;
-        cout << "Relevancy Score: " << fixed << setprecision(2) << articles[i].relevancyScore << "%" << endl;
-        cout << "Title: " << articles[i].title << endl;
-        cout << "Year: " << (articles[i].year > 0 ? to_string(articles[i].year) : "N/A") << endl;
-        cout << "Citations: " << articles[i].citationCount << endl;
-        
-        if (!articles[i].abstract.empty()) {
-            string abstract = articles[i].abstract;
-            if (abstract.length() > 300) {
-                abstract = abstract.substr(0, 297) + "...";
+    size_t total = max((size_t)1, (size_t)(options.loadRate * options.loadDurationSeconds));
+    vector<QueryResult> results(total);
+    vector<double> endToEnd(total);
+    atomic<size_t> next(0);
+    ostream quiet(nullptr);
+    
+    cerr << "Sending " << total << " questions at " << options.loadRate << "/s with up to "
+         << options.batchConcurrency << " in flight..." << endl;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    
+    runConcurrently(options.batchConcurrency, options.batchConcurrency, [&](size_t) {
+        while (true) {
+            size_t i = next++;
+            if (i >= total) {
+                return;
             }
-            cout << "Abstract: " << abstract << endl;
-        } else {
-            cout << "Abstract: N/A" << endl;
+            chrono::steady_clock::time_point scheduled =
+                start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(i / options.loadRate));
+            this_thread::sleep_until(scheduled);
+            
+            results[i] = runQuery(questions[i % questions.size()], options, quiet);
+            results[i].rankedArticles.clear();
+            endToEnd[i] = chrono::duration<double>(chrono::steady_clock::now() - scheduled).count();
+        }
+    });
+    
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    size_t statusCounts[3] = {0, 0, 0};
+    vector<double> classify, extract, validate, search, parse, score, sort, query;
+    for (const QueryResult& result : results) {
+        const StageTimings& timings = result.metrics.timings;
+        statusCounts[result.status]++;
+        classify.push_back(timings.classify);
+        query.push_back(timings.total);
+        if (result.status != QUERY_NOT_SCIENTIFIC) {
+            extract.push_back(timings.extract);
+            validate.push_back(timings.validate);
+        }
+        if (result.status == QUERY_OK) {
+            search.push_back(timings.search);
+            parse.push_back(timings.parse);
+            score.push_back(timings.score);
+            sort.push_back(timings.sort);
         }
-        
-        cout << "URL: " << articles[i].url << endl;
     }
     
-    cout << "\n--- Total articles found: " << articles.size() << " ---" << endl;
+    cout << "\n" << total << " questions in " << fixed << setprecision(1) << elapsed << "s ("
+         << setprecision(2) << total / elapsed << "/s achieved, " << options.loadRate << "/s offered): "
+         << statusCounts[QUERY_OK] << " ok, " << statusCounts[QUERY_NOT_SCIENTIFIC] << " not scientific, "
+         << statusCounts[QUERY_INVALID] << " invalid" << endl;
+    cout << "  " << left << setw(14) << "stage (ms)" << right << setw(10) << "p50" << setw(10) << "p95"
+         << setw(10) << "p99" << setw(10) << "max" << endl;
+    printLoadStage("classify", classify);
+    printLoadStage("extract", extract);
+    printLoadStage("validate", validate);
+    printLoadStage("search", search);
+    printLoadStage("parse", parse);
+    printLoadStage("score", score);
+    printLoadStage("sort", sort);
+    printLoadStage("query", query);
+    printLoadStage("end-to-end", endToEnd);
+    return 0;
+}
+
+// Function to train the local classifier from a classification log and save its weights
+// A fifth of the examples is held out first to report how the classifier would do at the threshold,
+// then the saved weights are trained on everything
+int runClassifierTraining(const ProgramOptions& options) {
+    const int EPOCHS = 30;
+    if (options.classifierPath.empty()) {
+        cerr << "--train-classifier needs --classifier FILE for the trained weights" << endl;
+        return 1;
+    }
+    vector<pair<string, bool>> examples;
+    if (!loadClassificationLog(options.trainClassifierInput, examples)) {
+        cerr << "Could not open " << options.trainClassifierInput << endl;
+        return 1;
+    }
+    if (examples.size() < 10) {
+        cerr << "Need at least 10 logged classifications to train, found " << examples.size() << endl;
+        return 1;
+    }
+    
+    vector<pair<string, bool>> training;
+    vector<pair<string, bool>> heldOut;
+    for (size_t i = 0; i < examples.size(); i++) {
+        (i % 5 == 4 ? heldOut : training).push_back(examples[i]);
+    }
+    QuestionClassifier classifier;
+    classifier.train(training, EPOCHS);
+    size_t correct = 0;
+    size_t confident = 0;
+    size_t confidentCorrect = 0;
+    for (const auto& example : heldOut) {
+        double probability = classifier.probability(example.first);
+        bool answer = probability >= 0.5;
+        correct += answer == example.second;
+        if (probability >= options.classifierThreshold || probability <= 1.0 - options.classifierThreshold) {
+            confident++;
+            confidentCorrect += answer == example.second;
+        }
+    }
+    
+    size_t scientific = count_if(examples.begin(), examples.end(), [](const pair<string, bool>& e) { return e.second; });
+    cout << "Training examples: " << examples.size() << " (" << scientific << " scientific)" << endl;
+    cout << fixed << setprecision(1);
+    cout << "Held-out accuracy: " << 100.0 * correct / heldOut.size() << "% of " << heldOut.size() << endl;
+    cout << "At threshold " << setprecision(2) << options.classifierThreshold << setprecision(1) << ": "
+         << 100.0 * confident / heldOut.size() << "% answered locally, "
+         << (confident > 0 ? 100.0 * confidentCorrect / confident : 0.0) << "% of those correct" << endl;
+    
+    classifier.train(examples, EPOCHS);
+    if (!classifier.save(options.classifierPath)) {
+        cerr << "Could not write " << options.classifierPath << endl;
+        return 1;
+    }
+    cout << "Weights written to " << options.classifierPath << endl;
+    return 0;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    ProgramOptions options;
+    if (!parseProgramOptions(argc, argv, options)) {
+        return 1;
+    }
+    
+    if (!options.benchmarkSizes.empty()) {
+        return runBenchmark(options);
+    }
+    if (!options.trainClassifierInput.empty()) {
+        return runClassifierTraining(options);
+    }
+    if (!options.replayInput.empty()) {
+        if (options.servePort < 0) {
+            cerr << "--replay needs --serve PORT" << endl;
+            return 1;
+        }
+        return runReplayServer(options);
+    }
+    
+    if (options.streamResults && options.sources != vector<string>{"semanticscholar"}) {
+        cerr << "--stream only works with --sources semanticscholar" << endl;
+        return 1;
+    }
+    
+    groqApiUrl = options.groqUrl;
+    groqStreaming = options.llmStreaming;
+    semanticScholarApiUrl = options.semanticScholarUrl;
+    openAlexApiUrl = options.openAlexUrl;
+    if (!options.recordOutput.empty() && !sharedRequestRecorder().open(options.recordOutput)) {
+        cerr << "Could not open " << options.recordOutput << " for recording" << endl;
+        return 1;
+    }
+    
+    if (!options.classifierLogPath.empty() && !sharedClassificationLog().open(options.classifierLogPath)) {
+        cerr << "Could not open " << options.classifierLogPath << " for logging classifications" << endl;
+        return 1;
+    }
+    if (!options.classifierPath.empty() && !sharedQuestionClassifier().load(options.classifierPath)) {
+        cerr << "Warning: could not load classifier weights from " << options.classifierPath
+             << ", every question will be classified by the LLM" << endl;
+    }
+    
+    // Create the shared HTTP client (and initialize curl) before any thread uses it
+    sharedHttpClient();
+    SourceSearchGuard sourceSearches;  // Declared after it so abandoned searches finish before it is destroyed
+    
+    if (options.useCache && !sharedResponseCache().open(options.cacheDirectory, (size_t)options.cacheMaxMegabytes << 20)) {
+        cerr << "Warning: could not open response cache in " << options.cacheDirectory << ", continuing without it" << endl;
+    }
+    bool corpusSource = find(options.sources.begin(), options.sources.end(), "corpus") != options.sources.end();
+    if ((options.recordCorpus || options.localFirst || options.offline || corpusSource || options.scorer != SCORER_COSINE) &&
+        !sharedArticleCorpus().open(options.corpusDirectory)) {
+        cerr << "Warning: could not open local article corpus in " << options.corpusDirectory << endl;
+    }
+    
+    if (!options.batchInput.empty()) {
+        return runBatch(options);
+    }
+    if (!options.loadInput.empty()) {
+        return runLoad(options);
+    }
+    if (options.servePort >= 0) {
+        return runServer(options);
+    }
+    
     string question;
     
     cout << "=== Scientific Question Identifier ===" << endl;
@@ -717,84 +7020,22 @@ int main() {
     cout << "Enter your question: ";
     getline(cin, question);
     
-    // Step 1: Determine if it's a scientific question using Groq
-    cout << "\n--- Step 1: Classification ---" << endl;
-    cout << "Calling Groq API to classify question..." << endl;
-    
-    bool isScientific = isScientificQuestion(question);
-    
-    cout << "Is this a scientific question? " << (isScientific ? "TRUE" : "FALSE") << endl;
+    QueryResult result = runQuery(question, options, cout);
     
-    if (isScientific) {
-        // Step 2: Extract keywords
-        cout << "\n--- Step 2: Extracting Keywords ---" << endl;
-        cout << "Calling Groq API to extract keywords..." << endl;
-        
-        string keywords = extractKeywordsWithGroq(question);
-        
-        cout << "\nExtracted Keywords: " << keywords << endl;
-        
-        // Validate query and keywords using Groq
-        cout << "Validating query..." << endl;
-        string validationResult = validateQueryWithGroq(question, keywords);
-        
-        // Check if query is invalid
-        if (validationResult.find("INVALID") != string::npos) {
-            cout << "\n[ERROR] The query is invalid for one of the following reasons:" << endl;
-            cout << "  - Keywords are unrelated or nonsensical" << endl;
-            cout << "  - Query is just a list of keywords, not an actual question or research topic" << endl;
-            cout << "  - Concepts are contradictory or don't make sense together" << endl;
-            cout << "\nPlease rephrase as a proper scientific question or research statement." << endl;
-            return 0;
-        }
-        
-        cout << "Query validated successfully!" << endl;
-        
-        // Expand keywords to include individual words
-        string expandedKeywords = expandKeywords(keywords);
-        cout << "Expanded Keywords: " << expandedKeywords << endl;
-        
-        // Step 3: Search Semantic Scholar
-        cout << "\n--- Step 3: Searching Semantic Scholar ---" << endl;
-        cout << "Searching for articles..." << endl;
-        
-        vector<Article> articles = searchSemanticScholar(expandedKeywords);
-        
-        if (!articles.empty()) {
-            // Step 4: Score and rank articles
-            cout << "\n--- Step 4: Scoring and Ranking Articles ---" << endl;
-            cout << "Calculating relevancy scores..." << endl;
-            
-            time_t now = time(0);
-            tm* ltm = localtime(&now);
-            int currentYear = 1900 + ltm->tm_year;
-            
-            // Calculate relevancy scores
-            for (auto& article : articles) {
-                article.relevancyScore = calculateRelevancyScore(article, question, keywords, expandedKeywords, currentYear);
-            }
-            
-            // Sort by relevancy score (descending)
-            sort(articles.begin(), articles.end(), 
-                [](const Article& a, const Article& b) {
-                    return a.relevancyScore > b.relevancyScore;
-                });
-            
-            // Filter to top 15 articles
-            vector<Article> top15Articles;
-            size_t displayCount = min(articles.size(), (size_t)15);
-            for (size_t i = 0; i < displayCount; i++) {
-                top15Articles.push_back(articles[i]);
-            }
-            
-            // Display top 15 articles
-            cout << "\n--- Ranked Results (Top " << top15Articles.size() << " of " << articles.size() << " Articles) ---" << endl;
-            displayRankedArticles(top15Articles);
+    if (result.status == QUERY_OK) {
+        if (!result.rankedArticles.empty()) {
+            // Display the top articles
+            cout << "\n--- Ranked Results (Top " << result.rankedArticles.size() << " of " << result.candidateCount << " Articles) ---" << endl;
+            chrono::steady_clock::time_point displayStart = chrono::steady_clock::now();
+            displayRankedArticles(result.rankedArticles);
+            result.metrics.timings.display = chrono::duration<double>(chrono::steady_clock::now() - displayStart).count();
         } else {
             cout << "\nNo articles found for the given keywords." << endl;
         }
-    } else {
-        cout << "\nQuestion is not scientific. Skipping keyword extraction and article search." << endl;
+    }
+    
+    if (options.emitMetrics) {
+        cerr << "\nMetrics: " << queryMetricsToJson(result.metrics) << endl;
     }
     
     return 0;